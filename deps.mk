@@ -8,9 +8,60 @@ $(OBJ_DIR)/minimp3-minimp3.o : $(SRC_DIR)/minimp3/minimp3.c $(INC_DIR)/minimp3/m
 $(OBJ_DIR)/glad.o : $(SRC_DIR)/glad.c $(INC_DIR)/glad/glad.h $(INC_DIR)/KHR/khrplatform.h | create_dir
 	$(CC) $(CFLAGS) -c -o $@ $<
 
-$(OBJ_DIR)/audio.o : $(SRC_DIR)/audio.c $(INC_DIR)/audio.h $(INC_DIR)/minimp3/minimp3.h | create_dir
+$(OBJ_DIR)/audio.o : $(SRC_DIR)/audio.c $(INC_DIR)/audio.h $(INC_DIR)/convert.h $(INC_DIR)/minimp3/minimp3.h $(INC_DIR)/resample.h $(INC_DIR)/sink.h $(INC_DIR)/stream.h $(INC_DIR)/minimp3/minimp3_ex.h $(INC_DIR)/minimp3/minimp3.h $(INC_DIR)/cache.h $(INC_DIR)/source.h | create_dir
 	$(CC) $(CFLAGS) -c -o $@ $<
 
-$(OBJ_DIR)/main.o : $(SRC_DIR)/main.c $(INC_DIR)/GLFW/glfw3.h $(INC_DIR)/glad/glad.h $(INC_DIR)/KHR/khrplatform.h $(INC_DIR)/minimp3/minimp3.h $(INC_DIR)/minimp3/minimp3_ex.h $(INC_DIR)/minimp3/minimp3.h $(INC_DIR)/audio.h $(INC_DIR)/minimp3/minimp3.h $(INC_DIR)/fft.h | create_dir
+$(OBJ_DIR)/main.o : $(SRC_DIR)/main.c $(INC_DIR)/GLFW/glfw3.h $(INC_DIR)/glad/glad.h $(INC_DIR)/KHR/khrplatform.h $(INC_DIR)/minimp3/minimp3.h $(INC_DIR)/minimp3/minimp3_ex.h $(INC_DIR)/minimp3/minimp3.h $(INC_DIR)/audio.h $(INC_DIR)/convert.h $(INC_DIR)/minimp3/minimp3.h $(INC_DIR)/resample.h $(INC_DIR)/sink.h $(INC_DIR)/stream.h $(INC_DIR)/minimp3/minimp3_ex.h $(INC_DIR)/cache.h $(INC_DIR)/source.h $(INC_DIR)/czt.h $(INC_DIR)/fft.h $(INC_DIR)/decode.h $(INC_DIR)/fft.h $(INC_DIR)/goertzel.h $(INC_DIR)/multires.h $(INC_DIR)/onset.h $(INC_DIR)/pitch.h $(INC_DIR)/playlist.h $(INC_DIR)/psd.h $(INC_DIR)/scan.h $(INC_DIR)/spectrogram.h | create_dir
+	$(CC) $(CFLAGS) -c -o $@ $<
+
+$(OBJ_DIR)/onset.o : $(SRC_DIR)/onset.c $(INC_DIR)/onset.h $(INC_DIR)/minimp3/minimp3.h $(INC_DIR)/fft.h $(INC_DIR)/decode.h $(INC_DIR)/minimp3/minimp3_ex.h $(INC_DIR)/minimp3/minimp3.h | create_dir
+	$(CC) $(CFLAGS) -c -o $@ $<
+
+$(OBJ_DIR)/pitch.o : $(SRC_DIR)/pitch.c $(INC_DIR)/pitch.h $(INC_DIR)/minimp3/minimp3.h $(INC_DIR)/fft.h | create_dir
+	$(CC) $(CFLAGS) -c -o $@ $<
+
+$(OBJ_DIR)/czt.o : $(SRC_DIR)/czt.c $(INC_DIR)/czt.h $(INC_DIR)/minimp3/minimp3.h $(INC_DIR)/fft.h | create_dir
+	$(CC) $(CFLAGS) -c -o $@ $<
+
+$(OBJ_DIR)/multires.o : $(SRC_DIR)/multires.c $(INC_DIR)/multires.h $(INC_DIR)/minimp3/minimp3.h $(INC_DIR)/fft.h | create_dir
+	$(CC) $(CFLAGS) -c -o $@ $<
+
+$(OBJ_DIR)/psd.o : $(SRC_DIR)/psd.c $(INC_DIR)/psd.h $(INC_DIR)/minimp3/minimp3.h $(INC_DIR)/fft.h $(INC_DIR)/decode.h $(INC_DIR)/minimp3/minimp3_ex.h $(INC_DIR)/minimp3/minimp3.h | create_dir
+	$(CC) $(CFLAGS) -c -o $@ $<
+
+$(OBJ_DIR)/stream.o : $(SRC_DIR)/stream.c $(INC_DIR)/stream.h $(INC_DIR)/minimp3/minimp3.h $(INC_DIR)/minimp3/minimp3_ex.h $(INC_DIR)/minimp3/minimp3.h $(INC_DIR)/cache.h $(INC_DIR)/source.h | create_dir
+	$(CC) $(CFLAGS) -c -o $@ $<
+
+$(OBJ_DIR)/decode.o : $(SRC_DIR)/decode.c $(INC_DIR)/decode.h $(INC_DIR)/minimp3/minimp3.h $(INC_DIR)/minimp3/minimp3_ex.h $(INC_DIR)/minimp3/minimp3.h | create_dir
+	$(CC) $(CFLAGS) -c -o $@ $<
+
+$(OBJ_DIR)/cache.o : $(SRC_DIR)/cache.c $(INC_DIR)/cache.h $(INC_DIR)/minimp3/minimp3.h | create_dir
+	$(CC) $(CFLAGS) -c -o $@ $<
+
+$(OBJ_DIR)/spectrogram.o : $(SRC_DIR)/spectrogram.c $(INC_DIR)/spectrogram.h $(INC_DIR)/minimp3/minimp3.h $(INC_DIR)/cache.h $(INC_DIR)/fft.h | create_dir
+	$(CC) $(CFLAGS) -c -o $@ $<
+
+$(OBJ_DIR)/scan.o : $(SRC_DIR)/scan.c $(INC_DIR)/scan.h $(INC_DIR)/decode.h $(INC_DIR)/minimp3/minimp3.h $(INC_DIR)/minimp3/minimp3_ex.h $(INC_DIR)/minimp3/minimp3.h $(INC_DIR)/minimp3/minimp3.h $(INC_DIR)/minimp3/minimp3_ex.h | create_dir
+	$(CC) $(CFLAGS) -c -o $@ $<
+
+$(OBJ_DIR)/seekindex.o : $(SRC_DIR)/seekindex.c $(INC_DIR)/seekindex.h $(INC_DIR)/minimp3/minimp3.h $(INC_DIR)/minimp3/minimp3_ex.h $(INC_DIR)/minimp3/minimp3.h $(INC_DIR)/cache.h | create_dir
+	$(CC) $(CFLAGS) -c -o $@ $<
+
+$(OBJ_DIR)/playlist.o : $(SRC_DIR)/playlist.c $(INC_DIR)/playlist.h | create_dir
+	$(CC) $(CFLAGS) -c -o $@ $<
+
+$(OBJ_DIR)/source.o : $(SRC_DIR)/source.c $(INC_DIR)/source.h $(INC_DIR)/minimp3/minimp3.h $(INC_DIR)/minimp3/minimp3_ex.h $(INC_DIR)/minimp3/minimp3.h $(INC_DIR)/cache.h $(INC_DIR)/decode.h $(INC_DIR)/seekindex.h | create_dir
+	$(CC) $(CFLAGS) -c -o $@ $<
+
+$(OBJ_DIR)/sink.o : $(SRC_DIR)/sink.c $(INC_DIR)/sink.h $(INC_DIR)/minimp3/minimp3.h | create_dir
+	$(CC) $(CFLAGS) -c -o $@ $<
+
+$(OBJ_DIR)/resample.o : $(SRC_DIR)/resample.c $(INC_DIR)/resample.h $(INC_DIR)/minimp3/minimp3.h | create_dir
+	$(CC) $(CFLAGS) -c -o $@ $<
+
+$(OBJ_DIR)/convert.o : $(SRC_DIR)/convert.c $(INC_DIR)/convert.h $(INC_DIR)/minimp3/minimp3.h | create_dir
+	$(CC) $(CFLAGS) -c -o $@ $<
+
+$(OBJ_DIR)/goertzel.o : $(SRC_DIR)/goertzel.c $(INC_DIR)/goertzel.h | create_dir
 	$(CC) $(CFLAGS) -c -o $@ $<
 
@@ -1,38 +1,104 @@
 #ifndef _AUDIO_H_
 #define _AUDIO_H_
 
-#include "minimp3/minimp3.h"
+#include "convert.h"
+#include "resample.h"
+#include "sink.h"
+#include "stream.h"
 
 #include <stdbool.h>
 #ifdef WIN32
 #include <windows.h>
 #include <mmsystem.h>
+#include <mmreg.h>
 #else
 #include <alsa/asoundlib.h>
 #endif
+#include <pthread.h>
 #include <stdatomic.h>
 #include <stddef.h>
 
+/* output latency asked of the device unless the caller picks one */
+#define AUDIO_LATENCY_MS    100
+#ifdef WIN32
+/* queued wave blocks, each a quarter of the latency */
+#define AUDIO_NBLOCK        4
+#define AUDIO_MIN_BLOCK_FRAMES  256
+#else
+/* periods per device buffer */
+#define AUDIO_NPERIOD       4
+#endif
+
 struct audio_desc {
 #ifdef WIN32
   HWAVEOUT hWaveOut;
-  WAVEHDR waveHdr;
+  WAVEHDR waveHdr[AUDIO_NBLOCK];
+  mp3d_sample_t *blocks;
+  size_t basepos;                 /* the device counts from the last reset */
+  size_t block_frames;
 #else
   snd_pcm_t *pcm_handle;
-  size_t currpos;
   snd_pcm_uframes_t period_size;
+  snd_pcm_uframes_t buffer_size;
+  bool mmap;                      /* written through snd_pcm_mmap_begin() rather than snd_pcm_writei() */
+  enum convert_format format;     /* what the device takes, samples are converted on the way if it is not the sample type */
+  struct convert_dither dither;
+  uint8_t *formatted;             /* a period in 'format' for snd_pcm_writei() */
+  unsigned int device_rate;       /* what the device settled on, 'rate' stays the stream's */
+  bool resampling;                /* the rates differ, frames go out through 'resampler' */
+  struct resampler resampler;
+  mp3d_sample_t *converted;       /* a period of resampled frames, 'pending' from 'pendingpos' not written yet */
+  size_t pending;
+  size_t pendingpos;
 #endif
-  mp3d_sample_t *data;
-  size_t samples;
+  struct sink sink;               /* stands in for the device unless its kind is SINK_NONE */
+  pthread_t thread;               /* writes to alsa or the sink, see audio_lock() */
+  pthread_mutex_t lock;
+  atomic_bool quit;
+  size_t currpos;                 /* frames handed to the device, or the resampler in front of it */
+  struct pcm_stream *stream;
+  size_t trackstart;              /* device frame where 'stream' starts */
+  struct pcm_stream *next;        /* continues without a gap once 'stream' ends, if the format matches */
   int nchannel;
   unsigned int rate;
-  int avg_bitrate_kbps;
+  unsigned int latency_ms;        /* asked for by the caller, 0 for AUDIO_LATENCY_MS */
+  double latency;                 /* what the device settled on, in seconds */
+  atomic_size_t nxrun;            /* underruns so far, counted on the output thread */
+  /* audio clock: a device position read at 'clocktime', advanced at 'rate' from there */
+  size_t clockpos;
+  double clocktime;
+  bool clockrunning;
+  size_t clocklast;               /* the last prediction, the clock does not go back between seeks */
+  /* time to first sound: from 'starttime', set by the caller, until the device plays anything */
+  double starttime;
+  double first_sound;             /* in seconds, negative until it is heard */
+  /* seek to first sound: from audio_seek() until the device plays the new position */
+  bool seeking;
+  size_t seekpos;
+  double seektime;
+  double seek_latency;            /* of the last seek, in seconds */
+  double seek_latency_max;
+  double seek_latency_sum;
+  size_t nseek;
 };
 
+/* monotonic clock in seconds */
+double audio_now(void);
+/* open the device 'params' names, NULL for the default one, or a sink, see sink.h */
 void audio_play(struct audio_desc *desc, const char *params);
 void audio_free(struct audio_desc *desc);
 size_t audio_getpos(struct audio_desc *desc);
+/* the frame the device plays at 'when', a time of audio_now() slightly ahead, interpolated between
+ * device positions so it moves every rendered frame rather than every period */
+size_t audio_clock(struct audio_desc *desc, double when);
+/* 'stream' is written out and there is no 'next' to continue with */
 bool audio_end(struct audio_desc *desc);
+/* keep the device fed, called once per rendered frame. alsa and the sinks have a thread of their own for it */
 void audio_continue(struct audio_desc *desc);
+/* held while 'stream', 'next' and 'trackstart' are read or changed outside of audio.c */
+void audio_lock(struct audio_desc *desc);
+void audio_unlock(struct audio_desc *desc);
+/* drop what is queued on the device and continue at frame 'pos' of 'stream', with the lock held */
+void audio_seek(struct audio_desc *desc, size_t pos);
 
 #endif
@@ -0,0 +1,81 @@
+#ifndef _CACHE_H_
+#define _CACHE_H_
+
+#include "minimp3/minimp3.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#ifdef WIN32
+#include <windows.h>
+#endif
+
+/* bump whenever the decoder or the pcm it produces changes, old entries are then never hit */
+#define CACHE_VERSION     1
+/* least recently used entries are removed beyond this total */
+#define CACHE_MAX_BYTES   ((uint64_t)1 << 30)
+#define CACHE_PATH_MAX    1024
+
+/* a whole cache entry, mapped read-only so every process shares the page cache */
+struct cache_mapping {
+  void *base;
+  size_t size;
+#ifdef WIN32
+  HANDLE file;
+  HANDLE mapping;
+#endif
+};
+
+/* decoded pcm of one file */
+struct pcm_cache {
+  const mp3d_sample_t *data;
+  size_t nframe;
+  int nchannel;
+  unsigned int rate;
+  struct cache_mapping mapping;
+};
+
+/* writes a new entry next to its final name, renamed into place once complete */
+struct pcm_cache_writer {
+  FILE *file;
+  size_t nframe;
+  int nchannel;
+  char path[CACHE_PATH_MAX];
+  char tmppath[CACHE_PATH_MAX];
+};
+
+/* hash of the file content, returns false if the file can not be read.
+ * the hash is remembered in the cache directory, later calls read it back
+ * as long as the size and the mtime of the file are unchanged */
+bool cache_key(const char *path, uint64_t *key);
+/* the remembered hash only, returns false instead of reading the whole file */
+bool cache_recall_key(const char *path, uint64_t *key);
+/* hash of the absolute path, for entries checked against the size and mtime of the file instead */
+bool cache_name_key(const char *path, uint64_t *key);
+/* path of the entry for 'key' ending in 'suffix', the cache directory is created on the way */
+bool cache_path(char *path, size_t size, uint64_t key, const char *suffix);
+/* temporary name next to 'path', unique to this process */
+bool cache_tmppath(char *tmppath, size_t size, const char *path);
+/* map a whole file read-only */
+bool cache_map_file(struct cache_mapping *mapping, const char *path);
+/* map a whole entry and mark it as recently used */
+bool cache_map(struct cache_mapping *mapping, const char *path);
+void cache_unmap(struct cache_mapping *mapping);
+/* move a complete temporary file into place, then evict old entries */
+bool cache_commit(const char *tmppath, const char *path);
+
+/* map the pcm entry for 'key', returns false on a miss */
+bool cache_open(struct pcm_cache *cache, uint64_t key);
+void cache_close(struct pcm_cache *cache);
+
+/* returns false if the cache directory is not usable */
+bool cache_writer_begin(struct pcm_cache_writer *writer, int nchannel, unsigned int rate);
+/* returns false on a write error, the entry is dropped then */
+bool cache_writer_write(struct pcm_cache_writer *writer, const mp3d_sample_t *data, size_t nframe);
+/* publish the entry under the content key 'key' and evict old ones */
+void cache_writer_finish(struct pcm_cache_writer *writer, uint64_t key);
+/* drop an incomplete entry */
+void cache_writer_abort(struct pcm_cache_writer *writer);
+
+#endif
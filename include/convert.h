@@ -0,0 +1,39 @@
+#ifndef _CONVERT_H_
+#define _CONVERT_H_
+
+#include "minimp3/minimp3.h"
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* sample formats a device may take, little endian like the host.
+ * going to fewer bits than the samples carry adds triangular dither of one step of the
+ * format: float to 16 or 24 bits. 16 bit samples widen exactly to any of them */
+enum convert_format {
+  CONVERT_S16,
+  CONVERT_S24,                /* in the low three bytes of four */
+  CONVERT_S24_3,              /* three bytes each */
+  CONVERT_S32,
+  CONVERT_F32,
+};
+
+/* the sample type itself, copied as it is */
+#ifdef MINIMP3_FLOAT_OUTPUT
+#define CONVERT_NATIVE    CONVERT_F32
+#else
+#define CONVERT_NATIVE    CONVERT_S16
+#endif
+
+/* the dither noise comes from four xorshift generators, one per lane of four samples */
+struct convert_dither {
+  uint32_t state[4];
+};
+
+void convert_dither_init(struct convert_dither *dither);
+/* bytes per sample */
+size_t convert_bytes(enum convert_format format);
+/* 'nsample' samples of 'src' into 'dest' in 'format' */
+void convert_samples(void *dest, const mp3d_sample_t *src, size_t nsample, enum convert_format format,
+                     struct convert_dither *dither);
+
+#endif
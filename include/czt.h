@@ -0,0 +1,29 @@
+#ifndef _CZT_H_
+#define _CZT_H_
+
+#include "minimp3/minimp3.h"
+#include "fft.h"
+
+#include <stddef.h>
+
+/* chirp-z transform: 'm' bins evenly spaced over [f0, f1] from 'n' samples,
+ * evaluated through Bluestein's convolution with power of two FFTs.
+ * the input is hann windowed, the window is folded into the pre-chirp */
+struct czt_plan {
+  size_t n;
+  size_t m;
+  size_t logsize;             /* convolution size, 2 ^ logsize >= n + m - 1 */
+  fft_complex_t *prechirp;    /* w[n] * A ^ -n * W ^ (n ^ 2 / 2) */
+  fft_complex_t *postchirp;   /* W ^ (k ^ 2 / 2) */
+  fft_complex_t *kernel;      /* FFT of W ^ -(m ^ 2 / 2), computed once */
+  fft_complex_t *buffer;
+};
+
+void czt_init(struct czt_plan *plan, size_t n, size_t m, float f0, float f1, unsigned int rate);
+void czt_deinit(struct czt_plan *plan);
+/* X receives plan->m bins */
+void czt_transform(struct czt_plan *plan, const float *x, fft_complex_t *X);
+/* same as czt_transform(), on one channel of interleaved pcm */
+void czt_transform_pcm(struct czt_plan *plan, const mp3d_sample_t *data, size_t nchannel, size_t channel, fft_complex_t *X);
+
+#endif
@@ -0,0 +1,30 @@
+#ifndef _DECODE_H_
+#define _DECODE_H_
+
+#include "minimp3/minimp3.h"
+#include "minimp3/minimp3_ex.h"
+
+#include <stddef.h>
+
+/* chunks handed out per thread, more chunks balance uneven frames better */
+#define DECODE_CHUNKS_PER_THREAD  4
+/* chunks shorter than this spend too much time pre-decoding */
+#define DECODE_MIN_FRAMES         256
+
+/* full scale of a decoded sample. built with MINIMP3_FLOAT_OUTPUT (make FLOAT=1)
+ * minimp3 skips the rounding to int16 and everything downstream takes float */
+#ifdef MINIMP3_FLOAT_OUTPUT
+#define DECODE_SAMPLE_SCALE       1.0f
+#else
+#define DECODE_SAMPLE_SCALE       32768.0f
+#endif
+
+/* decode a whole file on 'nthread' threads, 0 for one per core.
+ * a drop-in for mp3dec_load(): same return codes, same trimming of the
+ * encoder delay and padding, and the pcm is bit-identical.
+ * info->buffer is malloc'd */
+int decode_load(const char *path, mp3dec_file_info_t *info, int nthread);
+/* number of online cores */
+int decode_ncpu(void);
+
+#endif
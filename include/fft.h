@@ -60,5 +60,14 @@ typedef struct fft_complex fft_complex_t;
 
 void fft(const fft_complex_t *restrict x, fft_complex_t *restrict X, size_t logsize);
 void fft_inplace(fft_complex_t *x, size_t logsize);
+/* transform 'count' consecutive frames of 2 ^ logsize points, one butterfly pass over all of them at a time */
+void fft_batch_inplace(fft_complex_t *x, size_t count, size_t logsize);
+/* inverse transform, scaled by 1 / N */
+void fft_inverse_inplace(fft_complex_t *x, size_t logsize);
+/* transform 2 ^ logsize real samples through a half size complex transform,
+ * X receives the 2 ^ (logsize - 1) + 1 non-negative frequencies */
+void fft_real(const float *restrict x, fft_complex_t *restrict X, size_t logsize);
+/* inverse of fft_real(), scaled by 1 / N. X is clobbered */
+void fft_real_inverse(fft_complex_t *restrict X, float *restrict x, size_t logsize);
 
 #endif
@@ -0,0 +1,38 @@
+#ifndef _GOERTZEL_H_
+#define _GOERTZEL_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+
+/* bins evaluated together, four vector registers of them. the recurrence is latency bound,
+ * so several independent chains are kept in flight */
+#define GOERTZEL_LANES  16
+
+/* evaluates a handful of arbitrary (not necessarily integer) DFT bins.
+ * state is kept between goertzel_feed() calls so a block can arrive in pieces */
+struct goertzel_bank {
+  size_t nbin;
+  size_t npadded;         /* nbin rounded up to GOERTZEL_LANES */
+  float *coeff;           /* 2 * cos(w) */
+  float *s1;
+  float *s2;
+  size_t nsample;
+};
+
+void goertzel_init(struct goertzel_bank *bank, const float *frequencies, size_t nbin, unsigned int rate);
+void goertzel_deinit(struct goertzel_bank *bank);
+void goertzel_reset(struct goertzel_bank *bank);
+void goertzel_feed(struct goertzel_bank *bank, const float *x, size_t n);
+/* |X(w)| ^ 2 of everything fed since the last reset */
+void goertzel_power(const struct goertzel_bank *bank, float *power);
+/* reset, feed one block and read the power */
+void goertzel_evaluate(struct goertzel_bank *bank, const float *x, size_t n, float *power);
+
+/* estimated nanoseconds to evaluate 'nbin' bins over 'n' samples, and for the fft_real()
+ * of the power of two covering them */
+double goertzel_cost(size_t nbin, size_t n);
+double goertzel_fft_cost(size_t n);
+/* whether the bank is the cheaper of the two */
+bool goertzel_beats_fft(size_t nbin, size_t n);
+
+#endif
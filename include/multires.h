@@ -0,0 +1,50 @@
+#ifndef _MULTIRES_H_
+#define _MULTIRES_H_
+
+#include "minimp3/minimp3.h"
+#include "fft.h"
+
+#include <stddef.h>
+
+/* every band is transformed with the same small FFT, longer windows come from
+ * decimating the input by powers of two instead of growing the transform */
+#define MULTIRES_LOGSIZE    9
+#define MULTIRES_SIZE       ((size_t)1 << MULTIRES_LOGSIZE)
+#define MULTIRES_MAXBAND    8
+#define MULTIRES_MAXLEVEL   8
+/* halfband lowpass used between two decimation levels */
+#define MULTIRES_NTAP       47
+
+struct multires_band {
+  size_t level;           /* decimated by 2 ^ level */
+  float fmin;
+  float fmax;
+  float *magnitude;       /* MULTIRES_SIZE / 2 + 1 amplitudes */
+};
+
+struct multires {
+  unsigned int rate;
+  size_t nband;
+  size_t nlevel;
+  struct multires_band bands[MULTIRES_MAXBAND];
+  /* per level ring buffer of the latest MULTIRES_SIZE samples, shared by all bands on that level */
+  float *history[MULTIRES_MAXLEVEL];
+  size_t count[MULTIRES_MAXLEVEL];
+  float *window;
+  float *frame;
+  fft_complex_t *spectrum;
+};
+
+/* band i covers [edges[i - 1], edges[i]) with a window of windows[i] samples at the input rate,
+ * the first band starts at 0 and the last one ends at rate / 2, so 'edges' has nband - 1 entries.
+ * windows must be powers of two no smaller than MULTIRES_SIZE */
+void multires_init(struct multires *mr, unsigned int rate, const size_t *windows, const float *edges, size_t nband);
+void multires_deinit(struct multires *mr);
+/* feed one channel of interleaved pcm */
+void multires_feed(struct multires *mr, const mp3d_sample_t *data, size_t nframe, size_t nchannel, size_t channel);
+/* transform the latest window of every band */
+void multires_analyze(struct multires *mr);
+/* stitch the bands into 'nout' evenly spaced amplitudes over [0, fmax) */
+void multires_resample(const struct multires *mr, float *out, size_t nout, float fmax);
+
+#endif
@@ -0,0 +1,57 @@
+#ifndef _ONSET_H_
+#define _ONSET_H_
+
+#include "minimp3/minimp3.h"
+#include "fft.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#define ONSET_LOGSIZE   10
+#define ONSET_HOP       512
+/* number of envelope values kept for the incremental tempo estimate */
+#define ONSET_HISTORY   1024
+
+#define ONSET_MIN_BPM   60.0f
+#define ONSET_MAX_BPM   200.0f
+
+struct onset_detector {
+  size_t logsize;
+  size_t hop;
+  unsigned int rate;
+  float *window;
+  float *frame;           /* last (1 << logsize) mono samples */
+  size_t nbuffered;       /* valid samples in 'frame' */
+  float *magnitude;       /* log magnitude of previous frame */
+  fft_complex_t *fftbuffer;
+
+  /* onset strength envelope, one value per hop */
+  float *envelope;        /* ring buffer of ONSET_HISTORY values */
+  size_t nframe;          /* total frames analysed */
+  float flux;             /* flux of the latest frame */
+  float mean;             /* running mean of flux, used as adaptive threshold */
+  bool onset;             /* whether the latest complete frame is an onset */
+};
+
+struct onset_analysis {
+  float *envelope;        /* onset strength for every hop, malloc'd */
+  size_t nframe;
+  float frame_rate;       /* envelope values per second */
+  float bpm;
+};
+
+void onset_init(struct onset_detector *det, unsigned int rate, size_t logsize, size_t hop);
+void onset_deinit(struct onset_detector *det);
+/* feed interleaved pcm, returns the number of onsets found in it */
+size_t onset_feed(struct onset_detector *det, const mp3d_sample_t *data, size_t nframe, size_t nchannel);
+/* estimate tempo from the envelope history, 0 if there is not enough of it */
+float onset_tempo(struct onset_detector *det);
+
+/* batch pass over a whole decoded buffer */
+void onset_analyze(struct onset_analysis *analysis, const mp3d_sample_t *data, size_t nframe, size_t nchannel, unsigned int rate);
+void onset_analysis_free(struct onset_analysis *analysis);
+
+/* autocorrelate an onset envelope and pick the strongest beat period */
+float onset_estimate_bpm(const float *envelope, size_t n, float frame_rate, float min_bpm, float max_bpm);
+
+#endif
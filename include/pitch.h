@@ -0,0 +1,35 @@
+#ifndef _PITCH_H_
+#define _PITCH_H_
+
+#include "minimp3/minimp3.h"
+#include "fft.h"
+
+#include <stddef.h>
+
+#define PITCH_LOGSIZE     11
+/* frames between two estimates, independent of how often anything is drawn */
+#define PITCH_HOP         1024
+#define PITCH_MIN_HZ      60.0f
+#define PITCH_MAX_HZ      1000.0f
+/* YIN absolute threshold on the cumulative mean normalized difference */
+#define PITCH_THRESHOLD   0.15f
+
+struct pitch_tracker {
+  size_t logsize;
+  unsigned int rate;
+  float *frame;                 /* 2 ^ logsize samples of one channel */
+  float *head;                  /* first half of frame, zero padded */
+  fft_complex_t *spectrum;
+  fft_complex_t *headspectrum;
+  float *correlation;
+  float *difference;            /* cumulative mean normalized difference, half a frame long */
+};
+
+void pitch_init(struct pitch_tracker *tracker, unsigned int rate, size_t logsize);
+void pitch_deinit(struct pitch_tracker *tracker);
+/* fundamental frequency of tracker->frame in Hz, 0 if unvoiced. 'confidence' may be NULL */
+float pitch_detect(struct pitch_tracker *tracker, float *confidence);
+/* load one channel of interleaved pcm into tracker->frame, then detect */
+float pitch_detect_pcm(struct pitch_tracker *tracker, const mp3d_sample_t *data, size_t nchannel, size_t channel, float *confidence);
+
+#endif
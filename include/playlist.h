@@ -0,0 +1,19 @@
+#ifndef _PLAYLIST_H_
+#define _PLAYLIST_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+
+/* the tracks to play in order */
+struct playlist {
+  char **paths;
+  size_t npath;
+  size_t capacity;
+};
+
+void playlist_init(struct playlist *playlist);
+void playlist_free(struct playlist *playlist);
+/* add a track, or every track of an M3U playlist (.m3u, .m3u8), returns false if it can not be read */
+bool playlist_add(struct playlist *playlist, const char *path);
+
+#endif
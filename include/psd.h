@@ -0,0 +1,44 @@
+#ifndef _PSD_H_
+#define _PSD_H_
+
+#include "minimp3/minimp3.h"
+#include "fft.h"
+
+#include <stddef.h>
+
+#define PSD_LOGSIZE   11
+/* 50% overlap */
+#define PSD_HOP       ((size_t)1 << (PSD_LOGSIZE - 1))
+/* frames handed to fft_batch_inplace() at once */
+#define PSD_BATCH     8
+
+/* Welch estimator: averages the periodograms of hann windowed, overlapped frames.
+ * the sums are running totals, the estimate can be read at any point */
+struct psd_welch {
+  size_t logsize;
+  size_t hop;
+  unsigned int rate;
+  float *window;
+  double window_power;    /* sum of squared window */
+  float *pending;         /* mono samples not yet consumed by a batch */
+  size_t npending;
+  fft_complex_t *batch;   /* PSD_BATCH frames */
+  double *sum;            /* sum of |X| ^ 2, 2 ^ (logsize - 1) + 1 bins */
+  size_t nframe;
+};
+
+void psd_init(struct psd_welch *psd, unsigned int rate, size_t logsize, size_t hop);
+void psd_deinit(struct psd_welch *psd);
+void psd_reset(struct psd_welch *psd);
+/* accumulate the mono mix of interleaved pcm */
+void psd_feed(struct psd_welch *psd, const mp3d_sample_t *data, size_t nframe, size_t nchannel);
+/* transform the complete frames still pending, without waiting for a full batch */
+void psd_flush(struct psd_welch *psd);
+/* add the totals of 'part' (same configuration) into 'psd' */
+void psd_merge(struct psd_welch *psd, const struct psd_welch *part);
+/* one-sided density in dB relative to full scale per Hz, 2 ^ (logsize - 1) + 1 bins */
+void psd_density(const struct psd_welch *psd, float *density);
+/* whole buffer in one pass */
+void psd_analyze(struct psd_welch *psd, const mp3d_sample_t *data, size_t nframe, size_t nchannel);
+
+#endif
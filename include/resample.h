@@ -0,0 +1,58 @@
+#ifndef _RESAMPLE_H_
+#define _RESAMPLE_H_
+
+#include "minimp3/minimp3.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/* polyphase sample rate converter, for a device that does not take the stream's rate.
+ * every output frame is a kaiser windowed sinc over 'ntaps' input frames, with the taps
+ * for each fractional position between two input frames computed once up front.
+ * a ratio of out / in that reduces to at most RESAMPLE_MAX_PHASES over anything is exact,
+ * any other is interpolated between the two nearest of RESAMPLE_MAX_PHASES positions */
+#define RESAMPLE_TAPS         128   /* per output frame when upsampling, more when downsampling */
+#define RESAMPLE_MAX_TAPS     1024
+#define RESAMPLE_MAX_PHASES   512
+/* input frames buffered per channel besides the taps */
+#define RESAMPLE_BLOCK        1024
+
+struct resampler {
+  int nchannel;
+  unsigned int inrate;
+  unsigned int outrate;
+  /* each output frame moves 'step' + 'frac' / 'den' input frames on */
+  size_t step;
+  uint64_t frac;
+  uint64_t den;
+  size_t ntaps;               /* a multiple of 8, for the vector loop */
+  size_t nphase;              /* 'den' when exact */
+  float *table;               /* 'nphase' + 1 rows of 'ntaps' */
+  float *history;             /* 'nchannel' rows of 'capacity' input frames */
+  size_t capacity;
+  size_t filled;
+  size_t pos;                 /* first input frame of the next output frame */
+  uint64_t phase;             /* and its fractional offset, out of 'den' */
+  size_t padding;             /* zeros still to go in after the input, see resample_flush() */
+  size_t padded;
+  bool flushed;
+};
+
+void resample_init(struct resampler *resampler, int nchannel, unsigned int inrate, unsigned int outrate);
+void resample_deinit(struct resampler *resampler);
+/* forget the input so far, for a seek */
+void resample_reset(struct resampler *resampler);
+/* write up to 'nout' interleaved frames to 'out' and take up to 'nin' from 'in' while doing so,
+ * returns the frames written, '*consumed' receives the frames taken. 'in' may be NULL if 'nin' is 0 */
+size_t resample_process(struct resampler *resampler, const mp3d_sample_t *in, size_t nin, size_t *consumed,
+                        mp3d_sample_t *out, size_t nout);
+/* the input has ended, pad the filter past it so its last frames come out too.
+ * input that still follows is taken after the padding */
+void resample_flush(struct resampler *resampler);
+/* flushed and written out */
+bool resample_drained(const struct resampler *resampler);
+/* input frames taken that have not come out yet */
+double resample_delay(const struct resampler *resampler);
+
+#endif
@@ -0,0 +1,25 @@
+#ifndef _SCAN_H_
+#define _SCAN_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/* format and length of a file, as far as the frame headers tell */
+struct scan_info {
+  uint64_t nframe;        /* pcm frames after decoding, encoder delay and padding removed */
+  int channels;
+  int hz;
+  int layer;
+  int avg_bitrate_kbps;
+  bool tagged;            /* the length comes from a Xing/LAME tag, nothing past the first frame was read */
+};
+
+/* read only frame headers, returns 0 or an MP3D_E_* code like mp3dec_load().
+ * untagged files are walked frame by frame, the count matches what the decoder
+ * produces unless the stream starts inside the bit reservoir of a cut frame */
+int scan_file(const char *path, struct scan_info *info);
+/* scan 'nfile' files on 'nthread' threads, 0 for one per core. errors[i] is the result of scan_file() */
+void scan_files(char **paths, int nfile, struct scan_info *infos, int *errors, int nthread);
+
+#endif
@@ -0,0 +1,26 @@
+#ifndef _SEEKINDEX_H_
+#define _SEEKINDEX_H_
+
+#include "minimp3/minimp3.h"
+#include "minimp3/minimp3_ex.h"
+
+#include <stdbool.h>
+
+/* bump whenever the layout changes or minimp3 indexes differently */
+#define SEEKINDEX_VERSION   1
+
+/* the frame index mp3dec_ex builds by scanning the whole file on its first seek,
+ * kept in the cache directory so later opens seek in O(log n) right away.
+ * an entry belongs to the absolute path of the file and is only used while
+ * the size and the modification time of the file are unchanged.
+ * offsets and sample positions are stored as varint deltas, about 4 bytes a frame */
+
+/* hand the saved index of 'path' to 'dec', opened with MP3D_SEEK_TO_SAMPLE.
+ * returns false if there is none or it is stale, 'dec' then scans on its first seek as usual */
+bool seekindex_load(mp3dec_ex_t *dec, const char *path);
+/* save the index 'dec' has built */
+bool seekindex_save(const mp3dec_ex_t *dec, const char *path);
+/* scan 'path' through a decoder of its own and save the index */
+bool seekindex_build(const char *path);
+
+#endif
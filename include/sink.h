@@ -0,0 +1,55 @@
+#ifndef _SINK_H_
+#define _SINK_H_
+
+#include "minimp3/minimp3.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdio.h>
+
+/* software stand-ins for the audio device, named where the device would be:
+ * - "null" takes frames at real time and drops them,
+ * - "null:fast" takes them as fast as they are decoded,
+ * - "wav:<path>" writes them to a wav file as fast as they are decoded.
+ * the wav file takes the format of the first track, playback stops before a track of another.
+ * a sink plays frame 'clockpos' at 'clocktime' and then goes on at 'rate',
+ * until it runs out of frames. times are in seconds of audio_now() */
+#define SINK_NULL_NAME      "null"
+#define SINK_NULL_FAST_NAME "null:fast"
+#define SINK_WAV_PREFIX     "wav:"
+
+enum sink_kind {
+  SINK_NONE,              /* the real device */
+  SINK_NULL,
+  SINK_WAV,
+};
+
+struct sink {
+  enum sink_kind kind;
+  bool fast;              /* takes whatever comes, plays it at once */
+  FILE *file;
+  int nchannel;
+  unsigned int rate;
+  size_t buffer;          /* frames it queues ahead of the clock */
+  size_t written;         /* frames taken since it was opened */
+  size_t clockpos;
+  double clocktime;
+  double opentime;
+};
+
+/* the sink 'params' names, SINK_NONE for a device */
+enum sink_kind sink_kind(const char *params);
+/* returns false if the wav file can not be created */
+bool sink_open(struct sink *sink, const char *params, int nchannel, unsigned int rate, size_t buffer, double now);
+/* finish the wav file and print the throughput */
+void sink_close(struct sink *sink, double now);
+/* frames taken but not played yet */
+size_t sink_delay(const struct sink *sink, double now);
+/* frames it takes right now */
+size_t sink_room(const struct sink *sink, double now);
+/* returns false if the wav file can not be written */
+bool sink_write(struct sink *sink, const mp3d_sample_t *data, size_t nframe, double now);
+/* drop what is queued, the clock stops where it is */
+void sink_drop(struct sink *sink, double now);
+
+#endif
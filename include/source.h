@@ -0,0 +1,87 @@
+#ifndef _SOURCE_H_
+#define _SOURCE_H_
+
+#include "minimp3/minimp3.h"
+#include "minimp3/minimp3_ex.h"
+#include "cache.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+/* a track is read from
+ * - an mp3 file,
+ * - a wav file (RIFF, integer or float pcm),
+ * - "raw:<rate>:<channels>:<format>:<path>", headerless little endian pcm
+ *   with format one of u8, s16, s24, s32, f32,
+ * - "-", standard input holding mp3 or wav, told apart by the first bytes.
+ *   "raw:...:-" reads headerless pcm from standard input.
+ * files are seekable, pipes are read once front to back */
+#define SOURCE_STDIN          "-"
+#define SOURCE_RAW_PREFIX     "raw:"
+/* mp3dec_ex seeks back over the head of the stream once while opening it,
+ * a pipe keeps at most this many bytes around for that */
+#define SOURCE_PIPE_HEAD_MAX  ((size_t)16 << 20)
+
+enum source_kind {
+  SOURCE_MP3,
+  SOURCE_PCM,
+};
+
+enum source_format {
+  SOURCE_U8,
+  SOURCE_S16,
+  SOURCE_S24,
+  SOURCE_S32,
+  SOURCE_F32,
+};
+
+/* replays the head of a pipe, so mp3dec_ex can seek back over what it sniffed */
+struct source_pipe {
+  FILE *file;
+  uint8_t *head;          /* the first 'nhead' bytes of the stream, freed once read past */
+  size_t nhead;
+  size_t capacity;
+  uint64_t pos;           /* read position in the stream */
+  bool recording;         /* whether reads still extend 'head' */
+};
+
+struct source {
+  enum source_kind kind;
+  int nchannel;
+  unsigned int rate;
+  size_t nframe;          /* length when it is known up front, 0 otherwise */
+  bool seekable;
+  bool failed;            /* the read stopped on an error rather than at the end */
+  char *path;             /* the file, NULL for standard input */
+  FILE *file;
+  struct source_pipe pipe;
+  mp3dec_io_t io;
+  /* mp3 */
+  mp3dec_ex_t dec;
+  bool indexed;           /* whether the seek index came from the cache */
+  /* pcm */
+  enum source_format format;
+  size_t frame_bytes;
+  struct cache_mapping mapping;
+  const uint8_t *pcm;     /* the samples inside 'mapping', NULL when read from a pipe */
+  uint8_t *scratch;       /* raw bytes read from a pipe, converted into the caller's buffer */
+  size_t scratch_bytes;
+  size_t pos;             /* next frame */
+  const mp3d_sample_t *frames;  /* 'pcm' itself when it already is in the sample format, read in place */
+};
+
+/* open the track named by 'path', returns 0 on success or an MP3D_E_* code */
+int source_open(struct source *source, const char *path);
+void source_close(struct source *source);
+/* read up to 'nframe' interleaved frames, fewer only at the end or on an error */
+size_t source_read(struct source *source, mp3d_sample_t *dest, size_t nframe);
+/* continue reading at frame 'pos', returns 0 on success */
+int source_seek(struct source *source, size_t pos);
+/* the source was read through without an error, called from the thread that read it */
+void source_finish(struct source *source);
+/* whether 'path' names standard input or headerless pcm rather than a plain file */
+bool source_special(const char *path);
+
+#endif
@@ -0,0 +1,50 @@
+#ifndef _SPECTROGRAM_H_
+#define _SPECTROGRAM_H_
+
+#include "minimp3/minimp3.h"
+#include "cache.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/* bump whenever the layout or the analysis changes */
+#define SPECTROGRAM_VERSION   1
+/* frames are SPECTROGRAM_HOP samples apart, about 11ms at 44.1kHz */
+#define SPECTROGRAM_HOP       512
+/* frames per block, the unit the index points at */
+#define SPECTROGRAM_BLOCK     256
+/* magnitudes are stored as 8 or 16 bit steps over [SPECTROGRAM_MIN_DB, SPECTROGRAM_MAX_DB],
+ * the lowest step stands for silence */
+#define SPECTROGRAM_BITS      8
+#define SPECTROGRAM_MIN_DB    -100.0f
+#define SPECTROGRAM_MAX_DB    10.0f
+
+/* a spectrogram computed ahead of time and mapped from the cache directory.
+ * the file is a header, one offset per block and the blocks, each block
+ * holding SPECTROGRAM_BLOCK frames (fewer for the last one) of 'nchannel'
+ * rows of 'nbin' quantized log magnitudes */
+struct spectrogram {
+  struct cache_mapping mapping;
+  const uint64_t *index;  /* byte offset of every block */
+  size_t nframe;
+  size_t nblock;
+  size_t hop;
+  size_t nbin;
+  int nchannel;
+  unsigned int bits;
+  float *levels;          /* amplitude of every quantization step */
+};
+
+/* analyse 'pcm' with 2 ^ logsize point transforms every SPECTROGRAM_HOP frames and store it under 'key'.
+ * magnitudes are |X| * 2 / N / scale, halved at 0 and N / 2, with a rectangular window.
+ * returns false if the file could not be written */
+bool spectrogram_build(uint64_t key, const mp3d_sample_t *pcm, size_t nframe, int nchannel, unsigned int rate,
+                       size_t logsize, float scale, unsigned int bits);
+/* map the spectrogram of 'key' made with 2 ^ logsize point transforms, returns false on a miss */
+bool spectrogram_open(struct spectrogram *spec, uint64_t key, size_t logsize);
+void spectrogram_close(struct spectrogram *spec);
+/* amplitudes of the frame nearest to sample 'pos', returns false past the last frame */
+bool spectrogram_frame(const struct spectrogram *spec, size_t pos, int channel, float *amplitudes);
+
+#endif
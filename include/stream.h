@@ -0,0 +1,86 @@
+#ifndef _STREAM_H_
+#define _STREAM_H_
+
+#include "minimp3/minimp3.h"
+#include "minimp3/minimp3_ex.h"
+#include "cache.h"
+#include "source.h"
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdio.h>
+
+/* frames held by the ring, a power of two */
+#define STREAM_CAPACITY   ((size_t)1 << 17)
+#define STREAM_MASK       (STREAM_CAPACITY - 1)
+/* frames kept behind the audio reader, for analysers looking at what is being heard */
+#define STREAM_HISTORY    (STREAM_CAPACITY / 2)
+/* the first STREAM_SPAN frames are mirrored past the end of the ring,
+ * so any window of up to STREAM_SPAN frames is contiguous in memory */
+#define STREAM_SPAN       ((size_t)1 << 14)
+/* frames kept past the history, as far as the audio reader may move on while an analyser reads */
+#define STREAM_GUARD      STREAM_SPAN
+/* frames decoded per source_read() call */
+#define STREAM_CHUNK      4096
+
+/* sleep of the decoder thread when the ring is full, in nanoseconds */
+#define STREAM_IDLE_NS    5000000
+
+/* a decoder thread reads a source into a bounded ring of pcm frames.
+ * the ring is single-producer/single-consumer and lock-free: the decoder
+ * only moves 'writepos', the audio writer only moves 'readpos'.
+ * analysers are extra readers that look at the history behind 'readpos'
+ * without holding the decoder back.
+ * positions are absolute frame indices since the start of the track.
+ * an mp3 decoded before is mapped from the pcm cache instead, and a pcm
+ * file in the sample format is used as is. then there is no decoder
+ * thread and every frame is readable from the start.
+ * a track decoded to its end leaves a seek index behind for later opens */
+struct pcm_stream {
+  struct source source;
+  int nchannel;
+  unsigned int rate;
+  mp3d_sample_t *data;    /* STREAM_CAPACITY + STREAM_SPAN frames */
+  uint64_t key;           /* content hash, names the cache entries of the file */
+  bool haskey;            /* whether 'key' was remembered from an earlier open */
+  struct pcm_cache cache; /* whole track, when it was cached */
+  const mp3d_sample_t *frames;  /* whole track in memory, from 'cache' or 'source' */
+  size_t nframe;
+  struct pcm_cache_writer writer;
+  bool caching;           /* whether decoded frames are also written to the cache */
+  atomic_size_t writepos; /* next frame to decode */
+  atomic_size_t readpos;  /* next frame for the audio writer */
+  size_t startpos;        /* where decoding last started, nothing before it is in the ring */
+  atomic_bool eof;
+  atomic_bool quit;
+  pthread_t thread;
+};
+
+/* open the track named by 'path' (see source.h) and start decoding in the background, returns 0 on success */
+int stream_open(struct pcm_stream *stream, const char *path);
+/* stop the decoder thread and release everything */
+void stream_close(struct pcm_stream *stream);
+/* drop everything buffered and continue from frame 'pos', called by the audio writer.
+ * the first chunk is decoded before returning, so output can restart right away.
+ * returns the position actually reached, clamped to the track when its length is known */
+size_t stream_seek(struct pcm_stream *stream, size_t pos);
+/* pipes are read once, stream_seek() must not be called on them */
+bool stream_seekable(const struct pcm_stream *stream);
+/* block until 'nframe' frames are readable or the file ends */
+void stream_wait(const struct pcm_stream *stream, size_t nframe);
+/* decoded frames the audio writer has not consumed yet */
+size_t stream_readable(const struct pcm_stream *stream);
+/* newest decoded frame plus one */
+size_t stream_written(const struct pcm_stream *stream);
+/* whether frames [pos, pos + nframe) are decoded and still inside the history */
+bool stream_has(const struct pcm_stream *stream, size_t pos, size_t nframe);
+/* interleaved frames starting at 'pos', contiguous for up to STREAM_SPAN frames */
+const mp3d_sample_t *stream_at(const struct pcm_stream *stream, size_t pos);
+void stream_consume(struct pcm_stream *stream, size_t nframe);
+/* the decoder reached the end of the file, what is left is in the ring */
+bool stream_decoded(const struct pcm_stream *stream);
+bool stream_end(const struct pcm_stream *stream);
+
+#endif
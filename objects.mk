@@ -4,3 +4,20 @@ $(OBJ_DIR)/minimp3-minimp3.o \
 $(OBJ_DIR)/glad.o \
 $(OBJ_DIR)/audio.o \
 $(OBJ_DIR)/main.o \
+$(OBJ_DIR)/onset.o \
+$(OBJ_DIR)/pitch.o \
+$(OBJ_DIR)/czt.o \
+$(OBJ_DIR)/multires.o \
+$(OBJ_DIR)/psd.o \
+$(OBJ_DIR)/stream.o \
+$(OBJ_DIR)/decode.o \
+$(OBJ_DIR)/cache.o \
+$(OBJ_DIR)/spectrogram.o \
+$(OBJ_DIR)/scan.o \
+$(OBJ_DIR)/seekindex.o \
+$(OBJ_DIR)/playlist.o \
+$(OBJ_DIR)/source.o \
+$(OBJ_DIR)/sink.o \
+$(OBJ_DIR)/resample.o \
+$(OBJ_DIR)/convert.o \
+$(OBJ_DIR)/goertzel.o \
@@ -3,6 +3,8 @@
 in float w;
 out vec4 fragment;
 
+uniform float beat;
+
 void main() {
-  fragment = vec4(1.0 * (1 - sqrt(w)), 1.0 * sqrt(w), 0.0, 1.0);
+  fragment = vec4(1.0 * (1 - sqrt(w)), 1.0 * sqrt(w), 0.5 * beat, 1.0);
 }
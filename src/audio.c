@@ -2,111 +2,337 @@
 
 #include <alsa/asoundlib.h>
 #include <pthread.h>
+#include <sched.h>
 
 #include <stdbool.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <time.h>
 
+double audio_now(void) {
 #ifdef WIN32
-bool audio_end(struct audio_desc *desc) {
-  return desc->waveHdr.dwFlags & WHDR_DONE;
+  LARGE_INTEGER frequency, counter;
+  QueryPerformanceFrequency(&frequency);
+  QueryPerformanceCounter(&counter);
+  return (double)counter.QuadPart / frequency.QuadPart;
+#else
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec * 1e-9;
+#endif
 }
 
-void audio_continue(struct audio_desc *desc) {
-  (void)desc;
+/* how long an output thread sleeps while the decoder has nothing new */
+#define AUDIO_IDLE_NS   1000000
+
+static void audio_sleep(long ns) {
+  struct timespec ts = { .tv_sec = 0, .tv_nsec = ns };
+  nanosleep(&ts, NULL);
 }
 
-size_t audio_getpos(struct audio_desc *desc) {
+static void audio_seek_begin(struct audio_desc *desc) {
+  desc->seeking = true;
+  desc->seekpos = desc->currpos;
+  desc->seektime = audio_now();
+  /* the clock starts over from the new position */
+  desc->clockrunning = false;
+  desc->clocklast = desc->currpos;
+}
+
+/* take a reading of the device position 'pos' at time 'stamp' into the clock.
+ * drivers may move their position a period at a time, a reading up to 'granularity'
+ * frames behind the prediction keeps the prediction, so the clock runs smoothly */
+static void audio_clock_update(struct audio_desc *desc, size_t pos, double stamp, bool running, size_t granularity) {
+  double predicted = desc->clockpos + (stamp - desc->clocktime) * desc->rate;
+  if (!desc->clockrunning || !running || pos > predicted || predicted - pos > granularity) {
+    desc->clockpos = pos;
+    desc->clocktime = stamp;
+  }
+  desc->clockrunning = running;
+}
+
+/* the clock advanced to 'when', never past what the device was given and never backwards */
+static size_t audio_clock_predict(struct audio_desc *desc, double when) {
+  size_t pos = desc->clockpos;
+  if (desc->clockrunning && when > desc->clocktime)
+    pos += (size_t)((when - desc->clocktime) * desc->rate);
+  if (pos > desc->currpos)
+    pos = desc->currpos;
+  if (pos < desc->clocklast)
+    pos = desc->clocklast;
+  desc->clocklast = pos;
+  return pos;
+}
+
+/* the first time the device is heard past the seek target, the time it took minus what was played since */
+static void audio_seek_check(struct audio_desc *desc, size_t pos) {
+  if (!desc->seeking || pos <= desc->seekpos)
+    return;
+  double latency = audio_now() - desc->seektime - (double)(pos - desc->seekpos) / desc->rate;
+  if (latency < 0.0)
+    latency = 0.0;
+  desc->seeking = false;
+  desc->seek_latency = latency;
+  desc->seek_latency_sum += latency;
+  if (latency > desc->seek_latency_max)
+    desc->seek_latency_max = latency;
+  desc->nseek++;
+}
+
+/* the first time the device is heard at all, the time since 'starttime' minus what was played since */
+static void audio_start_check(struct audio_desc *desc, size_t pos) {
+  if (desc->first_sound >= 0.0 || pos == 0)
+    return;
+  double latency = audio_now() - desc->starttime - (double)pos / desc->rate;
+  desc->first_sound = latency < 0.0 ? 0.0 : latency;
+}
+
+static bool audio_gapless(const struct audio_desc *desc) {
+  const struct pcm_stream *next = desc->next;
+  return next && next->nchannel == desc->stream->nchannel && next->rate == desc->stream->rate;
+}
+
+/* once a track is written out the next one follows in the same device stream, nothing is drained */
+static void audio_advance(struct audio_desc *desc) {
+  if (!stream_end(desc->stream) || !audio_gapless(desc))
+    return;
+  desc->stream = desc->next;
+  desc->next = NULL;
+  desc->trackstart = desc->currpos;
+}
+
+#ifdef WIN32
+static bool audio_device_end(struct audio_desc *desc) {
+  if (!stream_end(desc->stream) || audio_gapless(desc))
+    return false;
+  for (int i = 0; i < AUDIO_NBLOCK; ++i) {
+    if (!(desc->waveHdr[i].dwFlags & WHDR_DONE))
+      return false;
+  }
+  return true;
+}
+
+static void audio_device_continue(struct audio_desc *desc) {
+  /* every block played out while there was more to come */
+  int ndone = 0;
+  for (int i = 0; i < AUDIO_NBLOCK; ++i)
+    ndone += (desc->waveHdr[i].dwFlags & WHDR_DONE) != 0;
+  if (ndone == AUDIO_NBLOCK && desc->currpos > desc->basepos && !stream_end(desc->stream))
+    desc->nxrun++;
+
+  for (int i = 0; i < AUDIO_NBLOCK; ++i) {
+    WAVEHDR *hdr = &desc->waveHdr[i];
+    if (!(hdr->dwFlags & WHDR_DONE))
+      continue;
+    audio_advance(desc);
+    struct pcm_stream *stream = desc->stream;
+    size_t readable = stream_readable(stream);
+    size_t nframe = readable > desc->block_frames ? desc->block_frames : readable;
+    if (nframe == 0)
+      return;
+
+    // 把流中的数据复制到空闲的缓冲区
+    if (hdr->dwFlags & WHDR_PREPARED)
+      waveOutUnprepareHeader(desc->hWaveOut, hdr, sizeof(WAVEHDR));
+    memcpy(hdr->lpData, stream_at(stream, desc->currpos - desc->trackstart), sizeof (desc->blocks[0]) * nframe * desc->nchannel);
+    hdr->dwBufferLength = sizeof (desc->blocks[0]) * nframe * desc->nchannel;
+    hdr->dwFlags = 0;
+    if (waveOutPrepareHeader(desc->hWaveOut, hdr, sizeof(WAVEHDR)) != MMSYSERR_NOERROR ||
+        waveOutWrite(desc->hWaveOut, hdr, sizeof(WAVEHDR)) != MMSYSERR_NOERROR) {
+      fprintf(stderr, "Failed to write to wave output\n");
+      exit(EXIT_FAILURE);
+    }
+    desc->currpos += nframe;
+    stream_consume(stream, nframe);
+  }
+}
+
+static size_t audio_device_getpos(struct audio_desc *desc) {
   MMTIME mmtime;
   mmtime.wType = TIME_SAMPLES;
 
   waveOutGetPosition(desc->hWaveOut, &mmtime, sizeof(MMTIME));
-  return mmtime.u.sample;
+  size_t pos = desc->basepos + mmtime.u.sample;
+  audio_start_check(desc, pos);
+  audio_seek_check(desc, pos);
+  return pos;
 }
 
-void audio_play(struct audio_desc *desc, const char *params) {
+static size_t audio_device_clock(struct audio_desc *desc, double when) {
+  // 设备位置没有时间戳, 以读取时刻为准
+  MMTIME mmtime;
+  mmtime.wType = TIME_SAMPLES;
+  waveOutGetPosition(desc->hWaveOut, &mmtime, sizeof(MMTIME));
+  size_t pos = desc->basepos + mmtime.u.sample;
+  audio_clock_update(desc, pos, audio_now(), pos < desc->currpos, desc->block_frames);
+  return audio_clock_predict(desc, when);
+}
+
+static void audio_device_seek(struct audio_desc *desc, size_t pos) {
+  // 丢弃已排队的缓冲区, 设备位置从零重新计数
+  waveOutReset(desc->hWaveOut);
+  for (int i = 0; i < AUDIO_NBLOCK; ++i) {
+    if (desc->waveHdr[i].dwFlags & WHDR_PREPARED)
+      waveOutUnprepareHeader(desc->hWaveOut, &desc->waveHdr[i], sizeof(WAVEHDR));
+    desc->waveHdr[i].dwFlags = WHDR_DONE;
+  }
+  desc->currpos = desc->trackstart + stream_seek(desc->stream, pos);
+  desc->basepos = desc->currpos;
+  audio_seek_begin(desc);
+  audio_device_continue(desc);
+}
+
+static void audio_device_play(struct audio_desc *desc, const char *params) {
   (void)params;
   // 配置音频格式
   WAVEFORMATEX wf;
+#ifdef MINIMP3_FLOAT_OUTPUT
+  wf.wFormatTag = WAVE_FORMAT_IEEE_FLOAT;
+#else
   wf.wFormatTag = WAVE_FORMAT_PCM;
+#endif
   wf.nChannels = desc->nchannel;
-  wf.nSamplesPerSec = desc->hz;
-  wf.wBitsPerSample = sizeof (desc->data[0]) * CHAR_BIT;
+  wf.nSamplesPerSec = desc->rate;
+  wf.wBitsPerSample = sizeof (desc->blocks[0]) * CHAR_BIT;
   wf.nBlockAlign = wf.nChannels * (wf.wBitsPerSample / 8);
   wf.nAvgBytesPerSec = wf.nSamplesPerSec * wf.nBlockAlign;
   wf.cbSize = 0;
 
-  // 加载 PCM 数据
-  DWORD dataSize = sizeof (desc->data[0]) * desc->samples;
   // 打开音频输出设备
   if (waveOutOpen(&desc->hWaveOut, WAVE_MAPPER, &wf, 0, 0, CALLBACK_NULL) != MMSYSERR_NOERROR) {
     fprintf(stderr, "Failed to open wave output\n");
     exit(EXIT_FAILURE);
   }
 
-  // 配置和加载音频缓冲区
-  desc->waveHdr.lpData = (LPSTR)desc->data;
-  desc->waveHdr.dwBufferLength = dataSize;
-  desc->waveHdr.dwFlags = 0;
-  desc->waveHdr.dwLoops = 0;
-
-  if (waveOutPrepareHeader(desc->hWaveOut, &desc->waveHdr, sizeof(WAVEHDR)) != MMSYSERR_NOERROR) {
-    fprintf(stderr, "Failed to prepare wave header\n");
-    waveOutClose(desc->hWaveOut);
+  // 按延迟目标划分缓冲区, 全部标记为空闲
+  unsigned int latency_ms = desc->latency_ms ? desc->latency_ms : AUDIO_LATENCY_MS;
+  desc->block_frames = (size_t)desc->rate * latency_ms / 1000 / AUDIO_NBLOCK;
+  if (desc->block_frames < AUDIO_MIN_BLOCK_FRAMES)
+    desc->block_frames = AUDIO_MIN_BLOCK_FRAMES;
+  desc->latency = (double)desc->block_frames * AUDIO_NBLOCK / desc->rate;
+  desc->blocks = malloc(sizeof (desc->blocks[0]) * AUDIO_NBLOCK * desc->block_frames * desc->nchannel);
+  if (!desc->blocks) {
+    fprintf(stderr, "failed to allocate memory\n");
     exit(EXIT_FAILURE);
   }
+  for (int i = 0; i < AUDIO_NBLOCK; ++i) {
+    memset(&desc->waveHdr[i], 0, sizeof(WAVEHDR));
+    desc->waveHdr[i].lpData = (LPSTR)(desc->blocks + i * desc->block_frames * desc->nchannel);
+    desc->waveHdr[i].dwFlags = WHDR_DONE;
+  }
+  desc->currpos = 0;
+  desc->basepos = 0;
+  desc->trackstart = 0;
 
   // 播放音频
-  if (waveOutWrite(desc->hWaveOut, &desc->waveHdr, sizeof(WAVEHDR)) != MMSYSERR_NOERROR) {
-    fprintf(stderr, "Failed to write to wave output\n");
-    waveOutUnprepareHeader(desc->hWaveOut, &desc->waveHdr, sizeof(WAVEHDR));
-    waveOutClose(desc->hWaveOut);
-    exit(EXIT_FAILURE);
-  }
+  audio_device_continue(desc);
 }
 
-void audio_free(struct audio_desc *desc) {
-  waveOutUnprepareHeader(desc->hWaveOut, &desc->waveHdr, sizeof(WAVEHDR));
+static void audio_device_free(struct audio_desc *desc) {
+  waveOutReset(desc->hWaveOut);
+  for (int i = 0; i < AUDIO_NBLOCK; ++i) {
+    if (desc->waveHdr[i].dwFlags & WHDR_PREPARED)
+      waveOutUnprepareHeader(desc->hWaveOut, &desc->waveHdr[i], sizeof(WAVEHDR));
+  }
   waveOutClose(desc->hWaveOut);
+  free(desc->blocks);
 }
 #else
-void audio_play(struct audio_desc *desc, const char *params) {
-  snd_pcm_t *pcm_handle;
-  snd_pcm_hw_params_t *hw_params;
+/* how long the output thread blocks on the device before it looks for 'quit' again */
+#define AUDIO_WAIT_MS   100
 
-  const char *device = params ? params : "default";
-  int err = snd_pcm_open(&pcm_handle, device, SND_PCM_STREAM_PLAYBACK, SND_PCM_NONBLOCK);
-  if (err < 0) {
-    fprintf(stderr, "error: can not open default device\n");
-    exit(EXIT_FAILURE);
-  }
+/* tried on the device in order: the sample type itself, then the rest from the most bits down.
+ * a plug device takes any of them, a hw device the ones the hardware does */
+static const struct {
+  enum convert_format format;
+  snd_pcm_format_t alsa;
+} audio_formats[] = {
+#ifdef MINIMP3_FLOAT_OUTPUT
+  { CONVERT_F32, SND_PCM_FORMAT_FLOAT_LE },
+  { CONVERT_S32, SND_PCM_FORMAT_S32_LE },
+  { CONVERT_S24, SND_PCM_FORMAT_S24_LE },
+  { CONVERT_S24_3, SND_PCM_FORMAT_S24_3LE },
+  { CONVERT_S16, SND_PCM_FORMAT_S16_LE },
+#else
+  { CONVERT_S16, SND_PCM_FORMAT_S16_LE },
+  { CONVERT_S32, SND_PCM_FORMAT_S32_LE },
+  { CONVERT_S24, SND_PCM_FORMAT_S24_LE },
+  { CONVERT_S24_3, SND_PCM_FORMAT_S24_3LE },
+  { CONVERT_F32, SND_PCM_FORMAT_FLOAT_LE },
+#endif
+};
 
-  snd_pcm_hw_params_alloca(&hw_params);
-  snd_pcm_hw_params_any(pcm_handle, hw_params);
-  snd_pcm_hw_params_set_access(pcm_handle, hw_params, SND_PCM_ACCESS_RW_INTERLEAVED);
-  snd_pcm_hw_params_set_format(pcm_handle, hw_params, SND_PCM_FORMAT_S16_LE);
-  snd_pcm_hw_params_set_channels(pcm_handle, hw_params, desc->nchannel);
-  snd_pcm_hw_params_set_rate_near(pcm_handle, hw_params, &desc->rate, NULL);
-  snd_pcm_uframes_t period = 4096;
-  snd_pcm_hw_params_set_period_size_near(pcm_handle, hw_params, &period, 0);
-  snd_pcm_hw_params(pcm_handle, hw_params);
+#define AUDIO_NFORMAT   (sizeof (audio_formats) / sizeof (audio_formats[0]))
 
-  snd_pcm_prepare(pcm_handle);
+/* copy into the device ring in place, returns the frames written or a negative error like snd_pcm_writei() */
+static snd_pcm_sframes_t audio_mmap_write(struct audio_desc *desc, const mp3d_sample_t *data, snd_pcm_uframes_t nframe) {
+  snd_pcm_t *pcm_handle = desc->pcm_handle;
+  snd_pcm_sframes_t avail = snd_pcm_avail_update(pcm_handle);
+  if (avail < 0)
+    return avail;
+  if (avail == 0)
+    return -EAGAIN;
+  if ((snd_pcm_uframes_t)avail < nframe)
+    nframe = avail;
+  const snd_pcm_channel_area_t *areas;
+  snd_pcm_uframes_t offset;
+  int err = snd_pcm_mmap_begin(pcm_handle, &areas, &offset, &nframe);
+  if (err < 0)
+    return err;
+  /* interleaved, the first area covers every channel */
+  uint8_t *dest = (uint8_t *)areas[0].addr + (areas[0].first + offset * areas[0].step) / 8;
+  convert_samples(dest, data, nframe * desc->nchannel, desc->format, &desc->dither);
+  snd_pcm_sframes_t committed = snd_pcm_mmap_commit(pcm_handle, offset, nframe);
+  if (committed >= 0 && (snd_pcm_uframes_t)committed != nframe)
+    return -EPIPE;
+  /* nothing starts an mmap stream on its own */
+  if (committed > 0 && snd_pcm_state(pcm_handle) == SND_PCM_STATE_PREPARED)
+    snd_pcm_start(pcm_handle);
+  return committed;
+}
 
-  desc->pcm_handle = pcm_handle;
-  desc->currpos = 0;
-  desc->period_size = period;
+/* resample up to a period of what is decoded into 'converted', returns false if nothing came out */
+static bool audio_convert(struct audio_desc *desc) {
+  struct pcm_stream *stream = desc->stream;
+  size_t readable = stream_readable(stream);
+  /* stream_at() is only contiguous for STREAM_SPAN frames */
+  if (readable > STREAM_SPAN)
+    readable = STREAM_SPAN;
+  /* the last frames of the last track are still in the filter */
+  if (readable == 0 && stream_end(stream) && !audio_gapless(desc))
+    resample_flush(&desc->resampler);
+  const mp3d_sample_t *data = readable ? stream_at(stream, desc->currpos - desc->trackstart) : NULL;
+  size_t consumed;
+  desc->pending = resample_process(&desc->resampler, data, readable, &consumed, desc->converted, desc->period_size);
+  desc->pendingpos = 0;
+  desc->currpos += consumed;
+  stream_consume(stream, consumed);
+  return desc->pending > 0;
 }
 
-void audio_continue(struct audio_desc *desc) {
-  snd_pcm_uframes_t nframe = desc->samples / desc->nchannel;
-  if (desc->currpos >= nframe)
-    return;
+/* stream frames between what the device plays and 'currpos', given the 'delay' of the device in its own frames */
+static size_t audio_delay(const struct audio_desc *desc, snd_pcm_sframes_t delay) {
+  if (!desc->resampling)
+    return delay;
+  return (size_t)((double)(delay + desc->pending) * desc->rate / desc->device_rate + resample_delay(&desc->resampler));
+}
 
+/* top the device buffer up with what is decoded, called with 'lock' held.
+ * returns false if the stream ran dry before the device was full */
+static bool audio_write(struct audio_desc *desc) {
   snd_pcm_t *pcm_handle = desc->pcm_handle;
   while (true) {
+    audio_advance(desc);
+    struct pcm_stream *stream = desc->stream;
+    size_t remaining_frames = desc->resampling ? desc->pending : stream_readable(stream);
+    if (remaining_frames == 0 && (!desc->resampling || !audio_convert(desc)))
+      return false;
+
     snd_pcm_state_t state = snd_pcm_state(pcm_handle);
     if (state == SND_PCM_STATE_XRUN) {
+      desc->nxrun++;
       if (snd_pcm_recover(pcm_handle, -EPIPE, 0) < 0) {
         fprintf(stderr, "failed to recover from underrun\n");
         exit(EXIT_FAILURE);
@@ -116,36 +342,371 @@ void audio_continue(struct audio_desc *desc) {
         exit(EXIT_FAILURE);
       }
     }
-    size_t remaining_frames = nframe - desc->currpos;
     size_t writeframes = desc->period_size > remaining_frames ? remaining_frames : desc->period_size;
-    snd_pcm_sframes_t sframes = snd_pcm_writei(pcm_handle, desc->data + desc->nchannel * desc->currpos, writeframes);
+    /* stream_at() is only contiguous for STREAM_SPAN frames */
+    if (writeframes > STREAM_SPAN)
+      writeframes = STREAM_SPAN;
+    const mp3d_sample_t *data = stream_at(stream, desc->currpos - desc->trackstart);
+    if (desc->resampling) {
+      writeframes = desc->pending;
+      data = desc->converted + desc->pendingpos * desc->nchannel;
+    }
+    snd_pcm_sframes_t sframes;
+    if (desc->mmap) {
+      sframes = audio_mmap_write(desc, data, writeframes);
+    } else if (desc->format != CONVERT_NATIVE) {
+      convert_samples(desc->formatted, data, writeframes * desc->nchannel, desc->format, &desc->dither);
+      sframes = snd_pcm_writei(pcm_handle, desc->formatted, writeframes);
+    } else {
+      sframes = snd_pcm_writei(pcm_handle, data, writeframes);
+    }
     if (sframes == -EPIPE) {
       continue;
     } else if (sframes == -EAGAIN) {
-      return;
+      return true;
     } else if (sframes < 0) {
       fprintf(stderr, "error: %s\n", snd_strerror(sframes));
       exit(EXIT_FAILURE);
     }
-    desc->currpos += sframes;
-    return;
+    if (desc->resampling) {
+      desc->pending -= sframes;
+      desc->pendingpos += sframes;
+    } else {
+      desc->currpos += sframes;
+      stream_consume(stream, sframes);
+    }
   }
 }
 
-void audio_free(struct audio_desc *desc) {
+/* keeps the device buffer full on its own schedule, a slow frame on the render side does not underrun it */
+static void *audio_output(void *arg) {
+  struct audio_desc *desc = arg;
+  while (!atomic_load_explicit(&desc->quit, memory_order_relaxed)) {
+    pthread_mutex_lock(&desc->lock);
+    bool full = audio_write(desc);
+    pthread_mutex_unlock(&desc->lock);
+    /* wakes up once a period is free, or polls while the decoder catches up */
+    if (!full || snd_pcm_wait(desc->pcm_handle, AUDIO_WAIT_MS) < 0)
+      audio_sleep(AUDIO_IDLE_NS);
+  }
+  return NULL;
+}
+
+/* the buffer holds the latency target, split into AUDIO_NPERIOD periods */
+static int audio_configure(struct audio_desc *desc, snd_pcm_t *pcm_handle, snd_pcm_access_t access) {
+  snd_pcm_hw_params_t *hw_params;
+  snd_pcm_hw_params_alloca(&hw_params);
+  snd_pcm_hw_params_any(pcm_handle, hw_params);
+  int err = snd_pcm_hw_params_set_access(pcm_handle, hw_params, access);
+  if (err < 0)
+    return err;
+  size_t i = 0;
+  while (i < AUDIO_NFORMAT && snd_pcm_hw_params_test_format(pcm_handle, hw_params, audio_formats[i].alsa) < 0)
+    ++i;
+  if (i == AUDIO_NFORMAT)
+    return -EINVAL;
+  err = snd_pcm_hw_params_set_format(pcm_handle, hw_params, audio_formats[i].alsa);
+  if (err < 0)
+    return err;
+  desc->format = audio_formats[i].format;
+  snd_pcm_hw_params_set_channels(pcm_handle, hw_params, desc->nchannel);
+  /* a rate the hardware does not take is converted here rather than by the plug plugin */
+  desc->device_rate = desc->rate;
+  snd_pcm_hw_params_set_rate_resample(pcm_handle, hw_params, 0);
+  snd_pcm_hw_params_set_rate_near(pcm_handle, hw_params, &desc->device_rate, NULL);
+  unsigned int buffer_time = (desc->latency_ms ? desc->latency_ms : AUDIO_LATENCY_MS) * 1000;
+  unsigned int period_time = buffer_time / AUDIO_NPERIOD;
+  snd_pcm_hw_params_set_buffer_time_near(pcm_handle, hw_params, &buffer_time, NULL);
+  snd_pcm_hw_params_set_period_time_near(pcm_handle, hw_params, &period_time, NULL);
+  err = snd_pcm_hw_params(pcm_handle, hw_params);
+  if (err < 0)
+    return err;
+  snd_pcm_hw_params_get_period_size(hw_params, &desc->period_size, NULL);
+  snd_pcm_hw_params_get_buffer_size(hw_params, &desc->buffer_size);
+  desc->latency = (double)desc->buffer_size / desc->device_rate;
+  return 0;
+}
+
+static void audio_device_play(struct audio_desc *desc, const char *params) {
+  snd_pcm_t *pcm_handle;
+
+  const char *device = params ? params : "default";
+  int err = snd_pcm_open(&pcm_handle, device, SND_PCM_STREAM_PLAYBACK, SND_PCM_NONBLOCK);
+  if (err < 0) {
+    fprintf(stderr, "error: can not open default device\n");
+    exit(EXIT_FAILURE);
+  }
+
+  /* frames are copied straight into the device ring, without a write call each, where the device allows it */
+  desc->mmap = audio_configure(desc, pcm_handle, SND_PCM_ACCESS_MMAP_INTERLEAVED) >= 0;
+  if (!desc->mmap && audio_configure(desc, pcm_handle, SND_PCM_ACCESS_RW_INTERLEAVED) < 0) {
+    fprintf(stderr, "error: can not configure device %s\n", device);
+    exit(EXIT_FAILURE);
+  }
+
+  /* status timestamps on the clock audio_now() reads, for audio_clock() */
+  snd_pcm_sw_params_t *sw_params;
+  snd_pcm_sw_params_alloca(&sw_params);
+  snd_pcm_sw_params_current(pcm_handle, sw_params);
+  snd_pcm_sw_params_set_tstamp_mode(pcm_handle, sw_params, SND_PCM_TSTAMP_ENABLE);
+  snd_pcm_sw_params_set_tstamp_type(pcm_handle, sw_params, SND_PCM_TSTAMP_TYPE_MONOTONIC);
+  snd_pcm_sw_params(pcm_handle, sw_params);
+
+  snd_pcm_prepare(pcm_handle);
+
+  convert_dither_init(&desc->dither);
+  desc->formatted = NULL;
+  if (desc->format != CONVERT_NATIVE) {
+    for (size_t i = 0; i < AUDIO_NFORMAT; ++i) {
+      if (audio_formats[i].format == desc->format)
+        fprintf(stderr, "converting to %s\n", snd_pcm_format_name(audio_formats[i].alsa));
+    }
+    /* the ring itself is written in place */
+    if (!desc->mmap) {
+      desc->formatted = malloc(convert_bytes(desc->format) * desc->period_size * desc->nchannel);
+      if (!desc->formatted) {
+        fprintf(stderr, "failed to allocate memory\n");
+        exit(EXIT_FAILURE);
+      }
+    }
+  }
+
+  desc->resampling = desc->device_rate != desc->rate;
+  if (desc->resampling) {
+    fprintf(stderr, "resampling %u Hz to %u Hz\n", desc->rate, desc->device_rate);
+    resample_init(&desc->resampler, desc->nchannel, desc->rate, desc->device_rate);
+    desc->converted = malloc(sizeof (desc->converted[0]) * desc->period_size * desc->nchannel);
+    if (!desc->converted) {
+      fprintf(stderr, "failed to allocate memory\n");
+      exit(EXIT_FAILURE);
+    }
+    desc->pending = 0;
+  }
+
+  desc->pcm_handle = pcm_handle;
+  desc->currpos = 0;
+  desc->trackstart = 0;
+  /* the device is filled before the first frame is rendered */
+  audio_write(desc);
+
+  if (pthread_create(&desc->thread, NULL, audio_output, desc)) {
+    fprintf(stderr, "error: can not start the audio thread\n");
+    exit(EXIT_FAILURE);
+  }
+  /* real-time priority where the user is allowed it (rtprio in limits.conf), best effort otherwise */
+  struct sched_param param = { .sched_priority = sched_get_priority_min(SCHED_FIFO) };
+  pthread_setschedparam(desc->thread, SCHED_FIFO, &param);
+}
+
+static void audio_device_continue(struct audio_desc *desc) {
+  /* the output thread keeps the device fed */
+  (void)desc;
+}
+
+static void audio_device_free(struct audio_desc *desc) {
+  atomic_store_explicit(&desc->quit, true, memory_order_relaxed);
+  pthread_join(desc->thread, NULL);
+  /* a non-blocking drain returns at once and the tail of the track is cut */
+  snd_pcm_nonblock(desc->pcm_handle, 0);
   snd_pcm_drain(desc->pcm_handle);
   snd_pcm_close(desc->pcm_handle);
+  free(desc->formatted);
+  if (desc->resampling) {
+    resample_deinit(&desc->resampler);
+    free(desc->converted);
+  }
 }
 
-size_t audio_getpos(struct audio_desc *desc) {
+static size_t audio_device_getpos(struct audio_desc *desc) {
+  pthread_mutex_lock(&desc->lock);
   snd_pcm_sframes_t delay;
-  if (snd_pcm_delay(desc->pcm_handle, &delay) < 0)
-    return desc->currpos;
-  return desc->currpos - delay;
+  size_t pos = desc->currpos;
+  if (snd_pcm_delay(desc->pcm_handle, &delay) < 0) {
+    /* without a delay from the driver what is queued is still known, short of the hardware's own latency */
+    snd_pcm_sframes_t avail = snd_pcm_avail(desc->pcm_handle);
+    delay = avail >= 0 && (snd_pcm_uframes_t)avail < desc->buffer_size ? (snd_pcm_sframes_t)(desc->buffer_size - avail) : -1;
+  }
+  size_t behind = delay >= 0 ? audio_delay(desc, delay) : SIZE_MAX;
+  if (behind <= pos) {
+    pos -= behind;
+    audio_start_check(desc, pos);
+    audio_seek_check(desc, pos);
+  }
+  pthread_mutex_unlock(&desc->lock);
+  return pos;
 }
 
-bool audio_end(struct audio_desc *desc) {
-  return desc->currpos * desc->nchannel >= desc->samples;
+static void audio_device_seek(struct audio_desc *desc, size_t pos) {
+  snd_pcm_drop(desc->pcm_handle);
+  if (desc->resampling) {
+    resample_reset(&desc->resampler);
+    desc->pending = 0;
+  }
+  desc->currpos = desc->trackstart + stream_seek(desc->stream, pos);
+  snd_pcm_prepare(desc->pcm_handle);
+  audio_seek_begin(desc);
+  /* stream_seek() decoded the first chunk already, so it goes out right away */
+  audio_write(desc);
+  if (desc->currpos > desc->seekpos && snd_pcm_state(desc->pcm_handle) == SND_PCM_STATE_PREPARED)
+    snd_pcm_start(desc->pcm_handle);
+}
+
+static size_t audio_device_clock(struct audio_desc *desc, double when) {
+  pthread_mutex_lock(&desc->lock);
+  snd_pcm_status_t *status;
+  snd_pcm_status_alloca(&status);
+  if (snd_pcm_status(desc->pcm_handle, status) >= 0) {
+    snd_pcm_sframes_t delay = snd_pcm_status_get_delay(status);
+    snd_htimestamp_t tstamp;
+    snd_pcm_status_get_htstamp(status, &tstamp);
+    double now = audio_now(), stamp = tstamp.tv_sec + tstamp.tv_nsec * 1e-9;
+    /* a driver without timestamps, or on another clock */
+    if (stamp > now || now - stamp > 1.0)
+      stamp = now;
+    size_t behind = delay >= 0 ? audio_delay(desc, delay) : SIZE_MAX;
+    if (behind <= desc->currpos)
+      audio_clock_update(desc, desc->currpos - behind, stamp, snd_pcm_status_get_state(status) == SND_PCM_STATE_RUNNING,
+                         (size_t)desc->period_size * desc->rate / desc->device_rate);
+  }
+  size_t pos = audio_clock_predict(desc, when);
+  pthread_mutex_unlock(&desc->lock);
+  return pos;
+}
+
+static bool audio_device_end(struct audio_desc *desc) {
+  pthread_mutex_lock(&desc->lock);
+  bool end = stream_end(desc->stream) && !audio_gapless(desc) &&
+             (!desc->resampling || (desc->pending == 0 && resample_drained(&desc->resampler)));
+  pthread_mutex_unlock(&desc->lock);
+  return end;
 }
 
 #endif
+
+/* hand the sink what it takes, called with 'lock' held */
+static void audio_sink_write(struct audio_desc *desc) {
+  while (true) {
+    audio_advance(desc);
+    struct pcm_stream *stream = desc->stream;
+    double now = audio_now();
+    size_t nframe = stream_readable(stream), room = sink_room(&desc->sink, now);
+    if (nframe == 0 || room == 0)
+      return;
+    if (nframe > room)
+      nframe = room;
+    /* stream_at() is only contiguous for STREAM_SPAN frames */
+    if (nframe > STREAM_SPAN)
+      nframe = STREAM_SPAN;
+    if (!desc->sink.fast && !desc->seeking && desc->sink.written && sink_delay(&desc->sink, now) == 0)
+      desc->nxrun++;
+    if (!sink_write(&desc->sink, stream_at(stream, desc->currpos - desc->trackstart), nframe, now)) {
+      fprintf(stderr, "error: can not write to the wav file\n");
+      exit(EXIT_FAILURE);
+    }
+    desc->currpos += nframe;
+    stream_consume(stream, nframe);
+  }
+}
+
+static void *audio_sink_output(void *arg) {
+  struct audio_desc *desc = arg;
+  while (!atomic_load_explicit(&desc->quit, memory_order_relaxed)) {
+    pthread_mutex_lock(&desc->lock);
+    audio_sink_write(desc);
+    pthread_mutex_unlock(&desc->lock);
+    audio_sleep(AUDIO_IDLE_NS);
+  }
+  return NULL;
+}
+
+void audio_play(struct audio_desc *desc, const char *params) {
+  pthread_mutex_init(&desc->lock, NULL);
+  atomic_init(&desc->quit, false);
+  if (sink_kind(params) == SINK_NONE) {
+    audio_device_play(desc, params);
+    return;
+  }
+
+  unsigned int latency_ms = desc->latency_ms ? desc->latency_ms : AUDIO_LATENCY_MS;
+  size_t buffer = (size_t)desc->rate * latency_ms / 1000;
+  if (!sink_open(&desc->sink, params, desc->nchannel, desc->rate, buffer, audio_now())) {
+    fprintf(stderr, "error: can not open %s\n", params);
+    exit(EXIT_FAILURE);
+  }
+  desc->latency = desc->sink.fast ? 0.0 : (double)buffer / desc->rate;
+  desc->currpos = 0;
+  desc->trackstart = 0;
+  audio_sink_write(desc);
+  if (pthread_create(&desc->thread, NULL, audio_sink_output, desc)) {
+    fprintf(stderr, "error: can not start the audio thread\n");
+    exit(EXIT_FAILURE);
+  }
+}
+
+void audio_free(struct audio_desc *desc) {
+  if (desc->sink.kind == SINK_NONE) {
+    audio_device_free(desc);
+  } else {
+    atomic_store_explicit(&desc->quit, true, memory_order_relaxed);
+    pthread_join(desc->thread, NULL);
+    sink_close(&desc->sink, audio_now());
+  }
+  pthread_mutex_destroy(&desc->lock);
+}
+
+size_t audio_getpos(struct audio_desc *desc) {
+  if (desc->sink.kind == SINK_NONE)
+    return audio_device_getpos(desc);
+  pthread_mutex_lock(&desc->lock);
+  size_t pos = desc->currpos - sink_delay(&desc->sink, audio_now());
+  audio_start_check(desc, pos);
+  audio_seek_check(desc, pos);
+  pthread_mutex_unlock(&desc->lock);
+  return pos;
+}
+
+size_t audio_clock(struct audio_desc *desc, double when) {
+  if (desc->sink.kind == SINK_NONE)
+    return audio_device_clock(desc, when);
+  pthread_mutex_lock(&desc->lock);
+  double now = audio_now();
+  size_t delay = sink_delay(&desc->sink, now);
+  /* the simulated position is exact, the clock only has to carry it to 'when' */
+  audio_clock_update(desc, desc->currpos - delay, now, delay > 0, 0);
+  size_t pos = audio_clock_predict(desc, when);
+  pthread_mutex_unlock(&desc->lock);
+  return pos;
+}
+
+bool audio_end(struct audio_desc *desc) {
+  if (desc->sink.kind == SINK_NONE)
+    return audio_device_end(desc);
+  pthread_mutex_lock(&desc->lock);
+  bool end = stream_end(desc->stream) && !audio_gapless(desc);
+  pthread_mutex_unlock(&desc->lock);
+  return end;
+}
+
+void audio_continue(struct audio_desc *desc) {
+  if (desc->sink.kind == SINK_NONE)
+    audio_device_continue(desc);
+}
+
+void audio_lock(struct audio_desc *desc) {
+  pthread_mutex_lock(&desc->lock);
+}
+
+void audio_unlock(struct audio_desc *desc) {
+  pthread_mutex_unlock(&desc->lock);
+}
+
+void audio_seek(struct audio_desc *desc, size_t pos) {
+  if (desc->sink.kind == SINK_NONE) {
+    audio_device_seek(desc, pos);
+    return;
+  }
+  sink_drop(&desc->sink, audio_now());
+  desc->currpos = desc->trackstart + stream_seek(desc->stream, pos);
+  audio_seek_begin(desc);
+  audio_sink_write(desc);
+}
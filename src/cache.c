@@ -0,0 +1,500 @@
+#include "cache.h"
+
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#ifdef WIN32
+#include <process.h>
+#include <sys/stat.h>
+#define getpid _getpid
+#else
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <utime.h>
+#endif
+
+#define CACHE_MAGIC       "FFTPCM"
+#define CACHE_KEY_MAGIC   "FFTKEY"
+
+/* a writer's temporary file untouched this long is left over from a crash */
+#define CACHE_STALE_SECONDS   (24 * 60 * 60)
+
+struct cache_header {
+  char magic[8];
+  uint32_t version;
+  uint32_t sample_bytes;
+  uint32_t nchannel;
+  uint32_t rate;
+  uint64_t nframe;
+};
+
+/* the content key of a file, valid while its size and mtime are unchanged */
+struct cache_key_memo {
+  char magic[8];
+  uint32_t version;
+  uint32_t reserved;
+  uint64_t file_size;
+  int64_t file_mtime;
+  uint64_t key;
+};
+
+struct cache_entry {
+  char path[CACHE_PATH_MAX];
+  uint64_t size;
+  time_t mtime;
+  bool sidecar;           /* a key memo or seek index, a few bytes next to a pcm entry */
+};
+
+static bool cache_dir(char *dir, size_t size) {
+#ifdef WIN32
+  const char *base = getenv("LOCALAPPDATA");
+  if (!base || (size_t)snprintf(dir, size, "%s\\fftplayer", base) >= size)
+    return false;
+  CreateDirectoryA(dir, NULL);
+  return GetFileAttributesA(dir) != INVALID_FILE_ATTRIBUTES;
+#else
+  const char *xdg = getenv("XDG_CACHE_HOME");
+  const char *home = getenv("HOME");
+  int len;
+  if (xdg && *xdg)
+    len = snprintf(dir, size, "%s", xdg);
+  else if (home && *home)
+    len = snprintf(dir, size, "%s/.cache", home);
+  else
+    return false;
+  if (len < 0 || (size_t)len + sizeof ("/fftplayer") > size)
+    return false;
+  /* the base directory may not exist yet either */
+  mkdir(dir, 0755);
+  strcat(dir, "/fftplayer");
+  mkdir(dir, 0755);
+  struct stat st;
+  return stat(dir, &st) == 0 && S_ISDIR(st.st_mode);
+#endif
+}
+
+bool cache_path(char *path, size_t size, uint64_t key, const char *suffix) {
+  char dir[CACHE_PATH_MAX];
+  if (!cache_dir(dir, sizeof (dir)))
+    return false;
+  int len = snprintf(path, size, "%s/%016llx-%s", dir, (unsigned long long)key, suffix);
+  return len > 0 && (size_t)len < size;
+}
+
+bool cache_tmppath(char *tmppath, size_t size, const char *path) {
+  /* two players, or two streams of one player, producing the same entry must not write into the same file */
+  static atomic_uint counter;
+  int len = snprintf(tmppath, size, "%s.%d.%u.tmp", path, (int)getpid(), atomic_fetch_add(&counter, 1));
+  return len > 0 && (size_t)len < size;
+}
+
+static bool cache_pcm_path(char *path, size_t size, uint64_t key) {
+  /* the sample type is part of the name, so integer and float builds keep separate entries */
+  char suffix[32];
+  snprintf(suffix, sizeof (suffix), "%d-%d.pcm", CACHE_VERSION, (int)sizeof (mp3d_sample_t));
+  return cache_path(path, size, key, suffix);
+}
+
+/* 64 bit FNV-1a */
+#define CACHE_FNV_BASIS   0xcbf29ce484222325ull
+#define CACHE_FNV_PRIME   0x100000001b3ull
+
+static inline uint64_t cache_fnv(uint64_t hash, const unsigned char *buf, size_t n) {
+  for (size_t i = 0; i < n; ++i) {
+    hash ^= buf[i];
+    hash *= CACHE_FNV_PRIME;
+  }
+  return hash;
+}
+
+static bool cache_memo_path(char *path, size_t size, const char *file) {
+  uint64_t key;
+  char suffix[32];
+  if (!cache_name_key(file, &key))
+    return false;
+  snprintf(suffix, sizeof (suffix), "%d.key", CACHE_VERSION);
+  return cache_path(path, size, key, suffix);
+}
+
+static bool cache_stat(const char *path, uint64_t *size, int64_t *mtime) {
+  struct stat st;
+  if (stat(path, &st))
+    return false;
+  *size = st.st_size;
+  *mtime = st.st_mtime;
+  return true;
+}
+
+bool cache_recall_key(const char *path, uint64_t *key) {
+  char entry[CACHE_PATH_MAX];
+  uint64_t size;
+  int64_t mtime;
+  if (!cache_stat(path, &size, &mtime) || !cache_memo_path(entry, sizeof (entry), path))
+    return false;
+  FILE *file = fopen(entry, "rb");
+  if (!file)
+    return false;
+  struct cache_key_memo memo;
+  bool ok = fread(&memo, sizeof (memo), 1, file) == 1 && memcmp(memo.magic, CACHE_KEY_MAGIC, sizeof (CACHE_KEY_MAGIC)) == 0 &&
+            memo.version == CACHE_VERSION && memo.file_size == size && memo.file_mtime == mtime;
+  fclose(file);
+  if (ok)
+    *key = memo.key;
+  return ok;
+}
+
+bool cache_key(const char *path, uint64_t *key) {
+  if (cache_recall_key(path, key))
+    return true;
+  struct cache_key_memo memo = {
+    .magic = CACHE_KEY_MAGIC,
+    .version = CACHE_VERSION,
+  };
+  /* taken before reading, a file written meanwhile is hashed again next time */
+  bool stated = cache_stat(path, &memo.file_size, &memo.file_mtime);
+  FILE *file = fopen(path, "rb");
+  if (!file)
+    return false;
+  /* over the whole content */
+  uint64_t hash = CACHE_FNV_BASIS;
+  unsigned char buf[1 << 16];
+  size_t n;
+  while ((n = fread(buf, 1, sizeof (buf), file)) > 0)
+    hash = cache_fnv(hash, buf, n);
+  bool ok = !ferror(file);
+  fclose(file);
+  *key = hash;
+  if (!ok || !stated)
+    return ok;
+
+  /* remember it, the next open skips reading the whole file */
+  char entry[CACHE_PATH_MAX], tmppath[CACHE_PATH_MAX];
+  memo.key = hash;
+  if (!cache_memo_path(entry, sizeof (entry), path) || !cache_tmppath(tmppath, sizeof (tmppath), entry))
+    return true;
+  file = fopen(tmppath, "wb");
+  if (!file)
+    return true;
+  bool written = fwrite(&memo, sizeof (memo), 1, file) == 1;
+  if (fclose(file) || !written)
+    remove(tmppath);
+  else
+    cache_commit(tmppath, entry);
+  return true;
+}
+
+bool cache_name_key(const char *path, uint64_t *key) {
+  /* the same file reached through another relative path or a symlink must hash the same */
+#ifdef WIN32
+  char full[CACHE_PATH_MAX];
+  if (!_fullpath(full, path, sizeof (full)))
+    return false;
+#else
+  char *full = realpath(path, NULL);
+  if (!full)
+    return false;
+#endif
+  *key = cache_fnv(CACHE_FNV_BASIS, (const unsigned char *)full, strlen(full));
+#ifndef WIN32
+  free(full);
+#endif
+  return true;
+}
+
+static bool cache_header_valid(const struct cache_header *header, size_t size) {
+  if (memcmp(header->magic, CACHE_MAGIC, sizeof (CACHE_MAGIC)) || header->version != CACHE_VERSION ||
+      header->sample_bytes != sizeof (mp3d_sample_t) || header->nchannel == 0 || header->rate == 0)
+    return false;
+  /* a truncated entry is as good as none */
+  return size == sizeof (*header) + header->nframe * header->nchannel * sizeof (mp3d_sample_t);
+}
+
+bool cache_map_file(struct cache_mapping *mapping, const char *path) {
+  memset(mapping, 0, sizeof (*mapping));
+#ifdef WIN32
+  mapping->file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_DELETE, NULL, OPEN_EXISTING,
+                              FILE_ATTRIBUTE_NORMAL, NULL);
+  if (mapping->file == INVALID_HANDLE_VALUE)
+    return false;
+  LARGE_INTEGER size;
+  if (!GetFileSizeEx(mapping->file, &size) || size.QuadPart == 0) {
+    CloseHandle(mapping->file);
+    return false;
+  }
+  mapping->size = size.QuadPart;
+  mapping->mapping = CreateFileMappingA(mapping->file, NULL, PAGE_READONLY, 0, 0, NULL);
+  if (!mapping->mapping) {
+    CloseHandle(mapping->file);
+    return false;
+  }
+  mapping->base = MapViewOfFile(mapping->mapping, FILE_MAP_READ, 0, 0, 0);
+  if (!mapping->base) {
+    CloseHandle(mapping->mapping);
+    CloseHandle(mapping->file);
+    return false;
+  }
+#else
+  int fd = open(path, O_RDONLY);
+  if (fd < 0)
+    return false;
+  struct stat st;
+  if (fstat(fd, &st) || st.st_size == 0) {
+    close(fd);
+    return false;
+  }
+  mapping->size = st.st_size;
+  mapping->base = mmap(NULL, mapping->size, PROT_READ, MAP_SHARED, fd, 0);
+  close(fd);
+  if (mapping->base == MAP_FAILED) {
+    mapping->base = NULL;
+    return false;
+  }
+  /* playback walks it front to back */
+  madvise(mapping->base, mapping->size, MADV_SEQUENTIAL);
+#endif
+  return true;
+}
+
+bool cache_map(struct cache_mapping *mapping, const char *path) {
+  if (!cache_map_file(mapping, path))
+    return false;
+#ifdef WIN32
+  /* refresh the modification time, eviction goes by it */
+  HANDLE touch = CreateFileA(path, FILE_WRITE_ATTRIBUTES, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE,
+                             NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+  if (touch != INVALID_HANDLE_VALUE) {
+    FILETIME now;
+    GetSystemTimeAsFileTime(&now);
+    SetFileTime(touch, NULL, NULL, &now);
+    CloseHandle(touch);
+  }
+#else
+  /* refresh the modification time, eviction goes by it */
+  utime(path, NULL);
+#endif
+  return true;
+}
+
+void cache_unmap(struct cache_mapping *mapping) {
+  if (!mapping->base)
+    return;
+#ifdef WIN32
+  UnmapViewOfFile(mapping->base);
+  CloseHandle(mapping->mapping);
+  CloseHandle(mapping->file);
+#else
+  munmap(mapping->base, mapping->size);
+#endif
+  mapping->base = NULL;
+}
+
+bool cache_open(struct pcm_cache *cache, uint64_t key) {
+  char path[CACHE_PATH_MAX];
+  memset(cache, 0, sizeof (*cache));
+  if (!cache_pcm_path(path, sizeof (path), key) || !cache_map(&cache->mapping, path))
+    return false;
+
+  const struct cache_header *header = cache->mapping.base;
+  if (cache->mapping.size < sizeof (*header) || !cache_header_valid(header, cache->mapping.size)) {
+    cache_unmap(&cache->mapping);
+    return false;
+  }
+  cache->data = (const mp3d_sample_t *)(header + 1);
+  cache->nframe = header->nframe;
+  cache->nchannel = header->nchannel;
+  cache->rate = header->rate;
+  return true;
+}
+
+void cache_close(struct pcm_cache *cache) {
+  cache_unmap(&cache->mapping);
+  cache->data = NULL;
+}
+
+static int cache_entry_compare(const void *lhs, const void *rhs) {
+  const struct cache_entry *a = lhs;
+  const struct cache_entry *b = rhs;
+  if (a->sidecar != b->sidecar)
+    return a->sidecar ? 1 : -1;
+  return a->mtime < b->mtime ? -1 : a->mtime > b->mtime;
+}
+
+static bool cache_has_suffix(const char *name, const char *suffix) {
+  size_t len = strlen(name), suffixlen = strlen(suffix);
+  return len >= suffixlen && strcmp(name + len - suffixlen, suffix) == 0;
+}
+
+/* whether a file counts towards the cache size, 'entry' has its size and mtime.
+ * a temporary file of cache_tmppath() may be one another writer is still filling,
+ * its cache_commit() would fail if it went */
+static bool cache_entry_counts(struct cache_entry *entry, const char *name, time_t now) {
+  entry->sidecar = false;
+  if (cache_has_suffix(name, ".tmp"))
+    return now - entry->mtime > CACHE_STALE_SECONDS;
+  entry->sidecar = cache_has_suffix(name, ".key") || cache_has_suffix(name, ".idx");
+  return true;
+}
+
+static bool cache_entry_push(struct cache_entry **entries, size_t *nentry, size_t *capacity) {
+  if (*nentry == *capacity) {
+    size_t newcapacity = *capacity ? *capacity * 2 : 64;
+    struct cache_entry *newentries = realloc(*entries, sizeof (newentries[0]) * newcapacity);
+    if (!newentries)
+      return false;
+    *entries = newentries;
+    *capacity = newcapacity;
+  }
+  return true;
+}
+
+/* remove the least recently used entries until the total fits CACHE_MAX_BYTES.
+ * everything in the directory counts but the temporary files of writers still running,
+ * the sidecars go only once no pcm or spectrogram entry is left to remove */
+static void cache_evict(const char *dir) {
+  struct cache_entry *entries = NULL;
+  size_t nentry = 0, capacity = 0;
+  uint64_t total = 0;
+  time_t now = time(NULL);
+
+#ifdef WIN32
+  char pattern[CACHE_PATH_MAX];
+  snprintf(pattern, sizeof (pattern), "%s\\*", dir);
+  WIN32_FIND_DATAA data;
+  HANDLE find = FindFirstFileA(pattern, &data);
+  if (find == INVALID_HANDLE_VALUE)
+    return;
+  do {
+    if (data.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY)
+      continue;
+    if (!cache_entry_push(&entries, &nentry, &capacity))
+      break;
+    struct cache_entry *entry = &entries[nentry];
+    if ((size_t)snprintf(entry->path, sizeof (entry->path), "%s\\%s", dir, data.cFileName) >= sizeof (entry->path))
+      continue;
+    entry->size = ((uint64_t)data.nFileSizeHigh << 32) | data.nFileSizeLow;
+    /* windows file times count 100 ns from 1601, time() seconds from 1970 */
+    entry->mtime = (time_t)((((uint64_t)data.ftLastWriteTime.dwHighDateTime << 32) |
+                             data.ftLastWriteTime.dwLowDateTime) / 10000000 - 11644473600ull);
+    if (!cache_entry_counts(entry, data.cFileName, now))
+      continue;
+    total += entry->size;
+    ++nentry;
+  } while (FindNextFileA(find, &data));
+  FindClose(find);
+#else
+  DIR *dirp = opendir(dir);
+  if (!dirp)
+    return;
+  struct dirent *dirent;
+  while ((dirent = readdir(dirp))) {
+    if (!cache_entry_push(&entries, &nentry, &capacity))
+      break;
+    struct cache_entry *entry = &entries[nentry];
+    struct stat st;
+    if ((size_t)snprintf(entry->path, sizeof (entry->path), "%s/%s", dir, dirent->d_name) >= sizeof (entry->path) ||
+        stat(entry->path, &st) || !S_ISREG(st.st_mode))
+      continue;
+    entry->size = st.st_size;
+    entry->mtime = st.st_mtime;
+    if (!cache_entry_counts(entry, dirent->d_name, now))
+      continue;
+    total += entry->size;
+    ++nentry;
+  }
+  closedir(dirp);
+#endif
+
+  if (total > CACHE_MAX_BYTES) {
+    qsort(entries, nentry, sizeof (entries[0]), cache_entry_compare);
+    /* mapped entries stay readable after removal, their pages go with the last unmap */
+    for (size_t i = 0; i < nentry && total > CACHE_MAX_BYTES; ++i) {
+      if (remove(entries[i].path) == 0)
+        total -= entries[i].size;
+    }
+  }
+  free(entries);
+}
+
+bool cache_commit(const char *tmppath, const char *path) {
+#ifdef WIN32
+  if (!MoveFileExA(tmppath, path, MOVEFILE_REPLACE_EXISTING)) {
+#else
+  if (rename(tmppath, path)) {
+#endif
+    remove(tmppath);
+    return false;
+  }
+  char dir[CACHE_PATH_MAX];
+  if (cache_dir(dir, sizeof (dir)))
+    cache_evict(dir);
+  return true;
+}
+
+bool cache_writer_begin(struct pcm_cache_writer *writer, int nchannel, unsigned int rate) {
+  writer->file = NULL;
+  writer->nframe = 0;
+  writer->nchannel = nchannel;
+  /* named after the content only once it is complete */
+  char pending[CACHE_PATH_MAX];
+  if (!cache_path(pending, sizeof (pending), 0, "pending.pcm") ||
+      !cache_tmppath(writer->tmppath, sizeof (writer->tmppath), pending))
+    return false;
+
+  writer->file = fopen(writer->tmppath, "wb");
+  if (!writer->file)
+    return false;
+  /* the frame count is filled in by cache_writer_finish() */
+  struct cache_header header = {
+    .magic = CACHE_MAGIC,
+    .version = CACHE_VERSION,
+    .sample_bytes = sizeof (mp3d_sample_t),
+    .nchannel = nchannel,
+    .rate = rate,
+    .nframe = 0,
+  };
+  if (fwrite(&header, sizeof (header), 1, writer->file) != 1) {
+    cache_writer_abort(writer);
+    return false;
+  }
+  return true;
+}
+
+bool cache_writer_write(struct pcm_cache_writer *writer, const mp3d_sample_t *data, size_t nframe) {
+  if (!writer->file)
+    return false;
+  if (fwrite(data, sizeof (data[0]) * writer->nchannel, nframe, writer->file) != nframe) {
+    cache_writer_abort(writer);
+    return false;
+  }
+  writer->nframe += nframe;
+  return true;
+}
+
+void cache_writer_finish(struct pcm_cache_writer *writer, uint64_t key) {
+  if (!writer->file)
+    return;
+  uint64_t nframe = writer->nframe;
+  if (!cache_pcm_path(writer->path, sizeof (writer->path), key) || fseek(writer->file, offsetof(struct cache_header, nframe), SEEK_SET) ||
+      fwrite(&nframe, sizeof (nframe), 1, writer->file) != 1) {
+    cache_writer_abort(writer);
+    return;
+  }
+  int err = fclose(writer->file);
+  writer->file = NULL;
+  if (err)
+    remove(writer->tmppath);
+  else
+    cache_commit(writer->tmppath, writer->path);
+}
+
+void cache_writer_abort(struct pcm_cache_writer *writer) {
+  if (!writer->file)
+    return;
+  fclose(writer->file);
+  writer->file = NULL;
+  remove(writer->tmppath);
+}
@@ -0,0 +1,176 @@
+#include "convert.h"
+
+#include <math.h>
+#include <string.h>
+
+#if defined (__SSE2__) || defined (_M_X64)
+#include <emmintrin.h>
+#define CONVERT_SSE2
+#endif
+
+/* the largest float below 2 ^ 31, 2 ^ 31 itself does not fit */
+#define CONVERT_S32_MAX   2147483520.0f
+
+static inline uint32_t convert_xorshift(uint32_t *state) {
+  uint32_t x = *state;
+  x ^= x << 13;
+  x ^= x >> 17;
+  x ^= x << 5;
+  return *state = x;
+}
+
+/* the sum of two uniform values in steps, less one: triangular over (-1, 1) */
+static inline float convert_tpdf(uint32_t random) {
+  return (float)((random & 0xffff) + (random >> 16)) * (1.0f / 65536.0f) - 1.0f;
+}
+
+void convert_dither_init(struct convert_dither *dither) {
+  for (int i = 0; i < 4; ++i)
+    dither->state[i] = 0x9e3779b9u * (i + 1);
+}
+
+size_t convert_bytes(enum convert_format format) {
+  switch (format) {
+    case CONVERT_S16:
+      return 2;
+    case CONVERT_S24_3:
+      return 3;
+    case CONVERT_S24:
+    case CONVERT_S32:
+    case CONVERT_F32:
+      break;
+  }
+  return 4;
+}
+
+static inline void convert_put24(uint8_t *dest, int32_t value) {
+  dest[0] = (uint8_t)value;
+  dest[1] = (uint8_t)(value >> 8);
+  dest[2] = (uint8_t)(value >> 16);
+}
+
+static inline void convert_put(void *dest, size_t i, int32_t value, enum convert_format format) {
+  switch (format) {
+    case CONVERT_S16:
+      ((int16_t *)dest)[i] = (int16_t)value;
+      break;
+    case CONVERT_S24_3:
+      convert_put24((uint8_t *)dest + i * 3, value);
+      break;
+    case CONVERT_S24:
+    case CONVERT_S32:
+    case CONVERT_F32:
+      ((int32_t *)dest)[i] = value;
+      break;
+  }
+}
+
+#ifdef MINIMP3_FLOAT_OUTPUT
+/* one sample scaled to 'scale' steps, dithered with the next value of 'state' if it is not NULL,
+ * rounded to the nearest step within [-scale, scale - 1] */
+static inline int32_t convert_sample(float sample, float scale, float max, uint32_t *state) {
+  float value = sample * scale;
+  if (state)
+    value += convert_tpdf(convert_xorshift(state));
+  value = value > -scale ? value : -scale;
+  value = value < max ? value : max;
+  return (int32_t)lrintf(value);
+}
+
+/* from [-1, 1) to integers of 'bits', four samples at a time, the lanes go through the generators in turn */
+static void convert_integer(void *dest, const float *src, size_t nsample, enum convert_format format, int bits,
+                            struct convert_dither *dither) {
+  float scale = bits == 32 ? 2147483648.0f : (float)((int32_t)1 << (bits - 1));
+  float max = bits == 32 ? CONVERT_S32_MAX : scale - 1.0f;
+  /* float has no bits to spare below 24 */
+  uint32_t *state = bits < 32 ? dither->state : NULL;
+  size_t i = 0;
+#ifdef CONVERT_SSE2
+  __m128 vscale = _mm_set1_ps(scale), vmin = _mm_set1_ps(-scale), vmax = _mm_set1_ps(max);
+  __m128 vstep = _mm_set1_ps(1.0f / 65536.0f), vone = _mm_set1_ps(1.0f);
+  __m128i vstate = _mm_loadu_si128((const __m128i *)dither->state), vlow = _mm_set1_epi32(0xffff);
+  for (; i + 4 <= nsample; i += 4) {
+    __m128 value = _mm_mul_ps(_mm_loadu_ps(src + i), vscale);
+    if (state) {
+      vstate = _mm_xor_si128(vstate, _mm_slli_epi32(vstate, 13));
+      vstate = _mm_xor_si128(vstate, _mm_srli_epi32(vstate, 17));
+      vstate = _mm_xor_si128(vstate, _mm_slli_epi32(vstate, 5));
+      __m128i sum = _mm_add_epi32(_mm_and_si128(vstate, vlow), _mm_srli_epi32(vstate, 16));
+      value = _mm_add_ps(value, _mm_sub_ps(_mm_mul_ps(_mm_cvtepi32_ps(sum), vstep), vone));
+    }
+    __m128i result = _mm_cvtps_epi32(_mm_min_ps(_mm_max_ps(value, vmin), vmax));
+    if (format == CONVERT_S16) {
+      _mm_storel_epi64((__m128i *)((int16_t *)dest + i), _mm_packs_epi32(result, result));
+    } else if (format == CONVERT_S24_3) {
+      int32_t lanes[4];
+      _mm_storeu_si128((__m128i *)lanes, result);
+      for (int j = 0; j < 4; ++j)
+        convert_put24((uint8_t *)dest + (i + j) * 3, lanes[j]);
+    } else {
+      _mm_storeu_si128((__m128i *)((int32_t *)dest + i), result);
+    }
+  }
+  _mm_storeu_si128((__m128i *)dither->state, vstate);
+#else
+  for (; i + 4 <= nsample; i += 4) {
+    for (int j = 0; j < 4; ++j)
+      convert_put(dest, i + j, convert_sample(src[i + j], scale, max, state ? &state[j] : NULL), format);
+  }
+#endif
+  for (int j = 0; i < nsample; ++i, ++j)
+    convert_put(dest, i, convert_sample(src[i], scale, max, state ? &state[j] : NULL), format);
+}
+#endif
+
+void convert_samples(void *dest, const mp3d_sample_t *src, size_t nsample, enum convert_format format,
+                     struct convert_dither *dither) {
+  if (format == CONVERT_NATIVE) {
+    memcpy(dest, src, sizeof (src[0]) * nsample);
+    return;
+  }
+#ifdef MINIMP3_FLOAT_OUTPUT
+  switch (format) {
+    case CONVERT_S16:
+      convert_integer(dest, src, nsample, format, 16, dither);
+      break;
+    case CONVERT_S24:
+    case CONVERT_S24_3:
+      convert_integer(dest, src, nsample, format, 24, dither);
+      break;
+    case CONVERT_S32:
+      convert_integer(dest, src, nsample, format, 32, dither);
+      break;
+    case CONVERT_F32:
+      break;
+  }
+#else
+  (void)dither;
+  /* exact, plain loops the compiler vectorizes */
+  switch (format) {
+    case CONVERT_S24: {
+      int32_t *out = dest;
+      for (size_t i = 0; i < nsample; ++i)
+        out[i] = (int32_t)src[i] * 256;
+      break;
+    }
+    case CONVERT_S24_3:
+      for (size_t i = 0; i < nsample; ++i)
+        convert_put24((uint8_t *)dest + i * 3, (int32_t)src[i] * 256);
+      break;
+    case CONVERT_S32: {
+      int32_t *out = dest;
+      for (size_t i = 0; i < nsample; ++i)
+        out[i] = (int32_t)src[i] * 65536;
+      break;
+    }
+    case CONVERT_F32: {
+      float *out = dest;
+      for (size_t i = 0; i < nsample; ++i)
+        out[i] = src[i] * (1.0f / 32768.0f);
+      break;
+    }
+    case CONVERT_S16:
+      break;
+  }
+#endif
+}
@@ -0,0 +1,103 @@
+#include "czt.h"
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+static void *czt_alloc(size_t size) {
+  void *ptr = malloc(size);
+  if (!ptr) {
+    fprintf(stderr, "failed to allocate memory\n");
+    exit(EXIT_FAILURE);
+  }
+  return ptr;
+}
+
+/* e ^ (-i * pi * step * j ^ 2), reduced before converting to float to keep the phase exact for large j */
+static fft_complex_t czt_chirp(double step, size_t j) {
+  double phase = fmod(step * ((double)j * j), 2.0) * M_PI;
+  return (fft_complex_t) { cos(phase), -sin(phase) };
+}
+
+void czt_init(struct czt_plan *plan, size_t n, size_t m, float f0, float f1, unsigned int rate) {
+  size_t logsize = 0;
+  while (((size_t)1 << logsize) < n + m - 1)
+    ++logsize;
+  size_t size = (size_t)1 << logsize;
+
+  plan->n = n;
+  plan->m = m;
+  plan->logsize = logsize;
+  plan->prechirp = czt_alloc(sizeof (plan->prechirp[0]) * n);
+  plan->postchirp = czt_alloc(sizeof (plan->postchirp[0]) * m);
+  plan->kernel = czt_alloc(sizeof (plan->kernel[0]) * size);
+  plan->buffer = czt_alloc(sizeof (plan->buffer[0]) * size);
+
+  /* W = e ^ (-i * 2 * pi * df / rate), A = e ^ (i * 2 * pi * f0 / rate) */
+  double step = m > 1 ? (double)(f1 - f0) / (m - 1) / rate : 0.0;
+  double start = (double)f0 / rate;
+  for (size_t j = 0; j < n; ++j) {
+    double window = 0.5 - 0.5 * cos(2 * M_PI * j / n);
+    double phase = -2 * M_PI * fmod(start * j, 1.0);
+    fft_complex_t shift = { cos(phase), sin(phase) };
+    fft_complex_t chirp = czt_chirp(step, j);
+    FFT_COMPLEX_MUL(plan->prechirp[j], shift, chirp);
+    plan->prechirp[j].real *= window;
+    plan->prechirp[j].imag *= window;
+  }
+  for (size_t k = 0; k < m; ++k)
+    plan->postchirp[k] = czt_chirp(step, k);
+
+  /* v[j] = W ^ -(j ^ 2 / 2) for j in (-n, m), laid out circularly */
+  for (size_t j = 0; j < size; ++j)
+    plan->kernel[j] = (fft_complex_t) { 0.0f, 0.0f };
+  for (size_t j = 0; j < m; ++j) {
+    fft_complex_t chirp = czt_chirp(step, j);
+    plan->kernel[j] = (fft_complex_t) { chirp.real, -chirp.imag };
+  }
+  for (size_t j = 1; j < n; ++j) {
+    fft_complex_t chirp = czt_chirp(step, j);
+    plan->kernel[size - j] = (fft_complex_t) { chirp.real, -chirp.imag };
+  }
+  fft_inplace(plan->kernel, logsize);
+}
+
+void czt_deinit(struct czt_plan *plan) {
+  free(plan->prechirp);
+  free(plan->postchirp);
+  free(plan->kernel);
+  free(plan->buffer);
+}
+
+static void czt_convolve(struct czt_plan *plan, fft_complex_t *X) {
+  size_t size = (size_t)1 << plan->logsize;
+  fft_inplace(plan->buffer, plan->logsize);
+  for (size_t j = 0; j < size; ++j)
+    FFT_COMPLEX_SELFMUL(plan->buffer[j], plan->kernel[j]);
+  fft_inverse_inplace(plan->buffer, plan->logsize);
+  for (size_t k = 0; k < plan->m; ++k)
+    FFT_COMPLEX_MUL(X[k], plan->buffer[k], plan->postchirp[k]);
+}
+
+void czt_transform(struct czt_plan *plan, const float *x, fft_complex_t *X) {
+  size_t size = (size_t)1 << plan->logsize;
+  for (size_t j = 0; j < plan->n; ++j) {
+    plan->buffer[j].real = x[j] * plan->prechirp[j].real;
+    plan->buffer[j].imag = x[j] * plan->prechirp[j].imag;
+  }
+  for (size_t j = plan->n; j < size; ++j)
+    plan->buffer[j] = (fft_complex_t) { 0.0f, 0.0f };
+  czt_convolve(plan, X);
+}
+
+void czt_transform_pcm(struct czt_plan *plan, const mp3d_sample_t *data, size_t nchannel, size_t channel, fft_complex_t *X) {
+  size_t size = (size_t)1 << plan->logsize;
+  for (size_t j = 0; j < plan->n; ++j) {
+    float sample = data[j * nchannel + channel];
+    plan->buffer[j].real = sample * plan->prechirp[j].real;
+    plan->buffer[j].imag = sample * plan->prechirp[j].imag;
+  }
+  for (size_t j = plan->n; j < size; ++j)
+    plan->buffer[j] = (fft_complex_t) { 0.0f, 0.0f };
+  czt_convolve(plan, X);
+}
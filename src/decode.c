@@ -0,0 +1,319 @@
+#include "decode.h"
+
+#include <limits.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#ifdef WIN32
+#include <windows.h>
+#else
+#include <unistd.h>
+#endif
+
+/* bytes a layer 3 frame can reach back into the frames before it */
+#define DECODE_RESERVOIR    511
+/* header, crc and the largest side info never end up in the reservoir */
+#define DECODE_SIDE_BYTES   38
+
+struct decode_index {
+  uint64_t *offset;       /* where each frame is decoded from, offset[nframe] is the end of the stream */
+  size_t nframe;
+  size_t capacity;
+};
+
+struct decode_chunk {
+  size_t begin;           /* first frame */
+  size_t samples;
+  size_t nframe;          /* frames that produced samples */
+  size_t bitrate_kbps;    /* sum over those frames */
+  bool failed;
+};
+
+struct decode_job {
+  const uint8_t *buf;
+  uint64_t end;
+  const uint64_t *offset;
+  size_t nframe;          /* indexed frames */
+  size_t frame_samples;   /* upper bound of samples per frame, channels included */
+  int channels, hz, layer;
+  mp3d_sample_t *pcm;     /* frame_samples per indexed frame */
+  struct decode_chunk *chunks;
+  size_t nchunk;
+  atomic_size_t next;
+};
+
+int decode_ncpu(void) {
+#ifdef WIN32
+  SYSTEM_INFO sysinfo;
+  GetSystemInfo(&sysinfo);
+  int ncpu = sysinfo.dwNumberOfProcessors;
+#else
+  int ncpu = sysconf(_SC_NPROCESSORS_ONLN);
+#endif
+  return ncpu > 0 ? ncpu : 1;
+}
+
+static inline int decode_bytes(const struct decode_job *job, uint64_t pos) {
+  return job->end - pos > INT_MAX ? INT_MAX : (int)(job->end - pos);
+}
+
+/* where the decoder is handed the stream for each frame, junk skipped before the frame included.
+ * a header-only pass steps exactly like the decode does, mp3dec_iterate_buf() resyncs differently
+ * over the tags between concatenated files and the chunks would not line up with the serial decode */
+static int decode_index_build(struct decode_index *index, const struct decode_job *job, uint64_t start) {
+  mp3dec_t dec;
+  mp3dec_frame_info_t info;
+  mp3dec_init(&dec);
+  for (uint64_t pos = start; pos < job->end; pos += info.frame_bytes) {
+    /* a null pcm pointer only parses the header */
+    int samples = mp3dec_decode_frame(&dec, job->buf + pos, decode_bytes(job, pos), NULL, &info);
+    if (!info.frame_bytes)
+      break;
+    if (!samples)
+      continue;
+    /* one spare slot for the end of the stream */
+    if (index->nframe + 2 > index->capacity) {
+      size_t capacity = index->capacity ? index->capacity * 2 : 4096;
+      uint64_t *offsets = realloc(index->offset, sizeof (offsets[0]) * capacity);
+      if (!offsets)
+        return MP3D_E_MEMORY;
+      index->offset = offsets;
+      index->capacity = capacity;
+    }
+    index->offset[index->nframe++] = pos;
+  }
+  return 0;
+}
+
+/* decode the frames of one chunk the way mp3dec_load() would have reached them */
+static void decode_chunk(struct decode_job *job, size_t k) {
+  struct decode_chunk *chunk = &job->chunks[k];
+  size_t begin = chunk->begin;
+  size_t end = k + 1 == job->nchunk ? SIZE_MAX : job->chunks[k + 1].begin;
+
+  /* start early enough that the two frames before 'begin' see a full bit reservoir,
+   * those two leave the mdct overlap and the synthesis filter as the serial decode has them */
+  size_t first = begin > MINIMP3_PREDECODE_FRAMES ? begin - MINIMP3_PREDECODE_FRAMES : 0;
+  for (size_t nbyte = 0; first > 0 && nbyte < DECODE_RESERVOIR; ) {
+    size_t size = job->offset[first] - job->offset[first - 1];
+    nbyte += size > DECODE_SIDE_BYTES ? size - DECODE_SIDE_BYTES : 0;
+    --first;
+  }
+
+  mp3dec_t dec;
+  mp3dec_frame_info_t info;
+  mp3d_sample_t frame[MINIMP3_MAX_SAMPLES_PER_FRAME];
+  mp3dec_init(&dec);
+  uint64_t pos = job->offset[first];
+  while (pos < job->offset[begin]) {
+    /* the first frame goes in alone: a fresh decoder otherwise wants several frames in a row
+     * to sync on and skips whatever sits right before a tag between concatenated files */
+    int nbyte = pos == job->offset[first] ? (int)(job->offset[first + 1] - pos) : decode_bytes(job, pos);
+    mp3dec_decode_frame(&dec, job->buf + pos, nbyte, frame, &info);
+    if (!info.frame_bytes)
+      break;
+    pos += info.frame_bytes;
+  }
+  /* the frame walk must line up with the index, or the chunks would overlap */
+  if (pos != job->offset[begin]) {
+    chunk->failed = true;
+    return;
+  }
+
+  mp3d_sample_t *pcm = job->pcm + begin * job->frame_samples;
+  /* the last chunk runs to the end of the buffer, where the decoder may find frames the index walk did not */
+  size_t capacity = ((end == SIZE_MAX ? job->nframe : end) - begin) * job->frame_samples;
+  while (end == SIZE_MAX || pos < job->offset[end]) {
+    int samples = mp3dec_decode_frame(&dec, job->buf + pos, decode_bytes(job, pos), frame, &info);
+    if (samples) {
+      size_t nsample = (size_t)samples * info.channels;
+      if (info.hz != job->hz || info.layer != job->layer || info.channels != job->channels ||
+          nsample > job->frame_samples || chunk->samples + nsample > capacity) {
+        chunk->failed = true;
+        return;
+      }
+      memcpy(pcm + chunk->samples, frame, sizeof (frame[0]) * nsample);
+      chunk->samples += nsample;
+      chunk->bitrate_kbps += info.bitrate_kbps;
+      chunk->nframe++;
+    }
+    if (!info.frame_bytes)
+      break;
+    pos += info.frame_bytes;
+  }
+  if (end != SIZE_MAX && pos != job->offset[end])
+    chunk->failed = true;
+}
+
+static void *decode_worker(void *arg) {
+  struct decode_job *job = arg;
+  size_t k;
+  while ((k = atomic_fetch_add(&job->next, 1)) < job->nchunk)
+    decode_chunk(job, k);
+  return NULL;
+}
+
+static int decode_read_file(const char *path, uint8_t **pbuf, size_t *psize) {
+  FILE *file = fopen(path, "rb");
+  if (!file)
+    return MP3D_E_IOERROR;
+  long size;
+  if (fseek(file, 0, SEEK_END) || (size = ftell(file)) < 0 || fseek(file, 0, SEEK_SET)) {
+    fclose(file);
+    return MP3D_E_IOERROR;
+  }
+  /* mp3dec_load() can not map an empty file either */
+  if (size == 0) {
+    fclose(file);
+    return MP3D_E_IOERROR;
+  }
+  uint8_t *buf = malloc(size);
+  if (!buf) {
+    fclose(file);
+    return MP3D_E_MEMORY;
+  }
+  if (fread(buf, 1, size, file) != (size_t)size) {
+    free(buf);
+    fclose(file);
+    return MP3D_E_IOERROR;
+  }
+  fclose(file);
+  *pbuf = buf;
+  *psize = size;
+  return 0;
+}
+
+/* run the chunks, returns false if any of them could not be decoded in isolation */
+static bool decode_run(struct decode_job *job, int nthread) {
+  if ((size_t)nthread > job->nchunk)
+    nthread = job->nchunk;
+  pthread_t *threads = malloc(sizeof (threads[0]) * nthread);
+  int nstarted = 0;
+  if (threads) {
+    while (nstarted < nthread - 1 && !pthread_create(&threads[nstarted], NULL, decode_worker, job))
+      ++nstarted;
+  }
+  /* the calling thread works too, and finishes everything alone if no thread could be started */
+  decode_worker(job);
+  for (int i = 0; i < nstarted; ++i)
+    pthread_join(threads[i], NULL);
+  free(threads);
+
+  for (size_t k = 0; k < job->nchunk; ++k) {
+    if (job->chunks[k].failed)
+      return false;
+  }
+  return true;
+}
+
+int decode_load(const char *path, mp3dec_file_info_t *info, int nthread) {
+  memset(info, 0, sizeof (*info));
+  uint8_t *buf;
+  size_t size;
+  int err = decode_read_file(path, &buf, &size);
+  if (err)
+    return err;
+
+  /* reuse the vbr tag parsing of mp3dec_ex: first frame, encoder delay and padding */
+  mp3dec_ex_t ex;
+  err = mp3dec_ex_open_buf(&ex, buf, size, MP3D_SEEK_TO_SAMPLE | MP3D_DO_NOT_SCAN);
+  if (err || ex.info.channels == 0 || (ex.vbr_tag_found && ex.detected_samples == 0)) {
+    mp3dec_ex_close(&ex);
+    free(buf);
+    return err;
+  }
+
+  mp3dec_t probe;
+  mp3dec_frame_info_t probe_info;
+  mp3dec_init(&probe);
+  struct decode_job job = {
+    .buf = buf,
+    .end = ex.end_offset,
+    .channels = ex.info.channels,
+    .hz = ex.info.hz,
+    .layer = ex.info.layer,
+  };
+  /* the serial decoder starts right after the vbr tag, even if junk follows it */
+  struct decode_index index = { 0 };
+  err = decode_index_build(&index, &job, ex.start_offset);
+  if (err || index.nframe == 0) {
+    mp3dec_ex_close(&ex);
+    free(index.offset);
+    free(buf);
+    return err;
+  }
+  index.offset[index.nframe] = ex.end_offset;
+  job.offset = index.offset;
+  job.nframe = index.nframe;
+
+  if (nthread <= 0)
+    nthread = decode_ncpu();
+  size_t nchunk = index.nframe / DECODE_MIN_FRAMES;
+  if (nchunk > (size_t)nthread * DECODE_CHUNKS_PER_THREAD)
+    nchunk = (size_t)nthread * DECODE_CHUNKS_PER_THREAD;
+  if (nchunk == 0)
+    nchunk = 1;
+  job.nchunk = nchunk;
+  /* a null pcm pointer only parses the header */
+  job.frame_samples = (size_t)mp3dec_decode_frame(&probe, buf + index.offset[0], decode_bytes(&job, index.offset[0]),
+                                                  NULL, &probe_info) * job.channels;
+  if (job.frame_samples == 0)
+    job.frame_samples = MINIMP3_MAX_SAMPLES_PER_FRAME;
+  job.pcm = malloc(sizeof (job.pcm[0]) * job.frame_samples * index.nframe);
+  job.chunks = calloc(nchunk, sizeof (job.chunks[0]));
+  atomic_init(&job.next, 0);
+  if (!job.pcm || !job.chunks) {
+    mp3dec_ex_close(&ex);
+    free(job.pcm);
+    free(job.chunks);
+    free(index.offset);
+    free(buf);
+    return MP3D_E_MEMORY;
+  }
+  for (size_t k = 0; k < nchunk; ++k)
+    job.chunks[k].begin = k * index.nframe / nchunk;
+
+  if (!decode_run(&job, nthread)) {
+    /* streams that do not split cleanly, or that change format midway, go the serial way */
+    free(job.pcm);
+    mp3dec_t dec;
+    err = mp3dec_load_buf(&dec, buf, size, info, NULL, NULL);
+  } else {
+    /* close the gaps between the chunks, dropping the encoder delay off the front on the way
+     * as mp3dec_load() does, so every sample moves at most once */
+    size_t samples = 0, nframe = 0, bitrate_kbps = 0, skip = ex.to_skip > 0 ? (size_t)ex.to_skip : 0;
+    for (size_t k = 0; k < nchunk; ++k) {
+      struct decode_chunk *chunk = &job.chunks[k];
+      size_t drop = chunk->samples < skip ? chunk->samples : skip;
+      const mp3d_sample_t *src = job.pcm + chunk->begin * job.frame_samples + drop;
+      if (src != job.pcm + samples)
+        memmove(job.pcm + samples, src, sizeof (job.pcm[0]) * (chunk->samples - drop));
+      samples += chunk->samples - drop;
+      skip -= drop;
+      nframe += chunk->nframe;
+      bitrate_kbps += chunk->bitrate_kbps;
+    }
+    /* and the padding off the end */
+    if (ex.detected_samples && samples > ex.detected_samples)
+      samples = ex.detected_samples;
+
+    mp3d_sample_t *pcm = realloc(job.pcm, sizeof (pcm[0]) * samples);
+    info->buffer = pcm || !samples ? pcm : job.pcm;
+    info->samples = samples;
+    info->channels = job.channels;
+    info->hz = job.hz;
+    info->layer = job.layer;
+    if (nframe)
+      info->avg_bitrate_kbps = bitrate_kbps / nframe;
+  }
+
+  mp3dec_ex_close(&ex);
+  free(job.chunks);
+  free(index.offset);
+  free(buf);
+  return err;
+}
@@ -100,13 +100,12 @@ static inline void rader_inplace(fft_complex_t *array, size_t logsize) {
   }                                                               \
 } while (0)
 
-static void fft_raw(fft_complex_t *x, size_t logsize) {
+/* butterflies of a size 2 ^ logsize transform over [begin, end). when the range holds
+ * several consecutive frames, the same passes transform all of them at once */
+static void fft_raw_range(fft_complex_t *begin, fft_complex_t *end, size_t logsize) {
   if (unlikely(logsize == 0))
     return;
 
-  fft_complex_t *begin = x;
-  fft_complex_t *end = begin + ((size_t)1 << logsize);
-
   DO_BUTTERFLY(begin, end, 2);
 
   if (unlikely(logsize == 1)) /* size == 2 ? */
@@ -123,6 +122,10 @@ static void fft_raw(fft_complex_t *x, size_t logsize) {
 
 }
 
+static void fft_raw(fft_complex_t *x, size_t logsize) {
+  fft_raw_range(x, x + ((size_t)1 << logsize), logsize);
+}
+
 void fft(const fft_complex_t *restrict x, fft_complex_t *restrict X, size_t logsize) {
   rader(x, X, logsize);
   fft_raw(X, logsize);
@@ -132,3 +135,88 @@ void fft_inplace(fft_complex_t *x, size_t logsize) {
   rader_inplace(x, logsize);
   fft_raw(x, logsize);
 }
+
+void fft_batch_inplace(fft_complex_t *x, size_t count, size_t logsize) {
+  size_t size = (size_t)1 << logsize;
+  for (size_t i = 0; i < count; ++i)
+    rader_inplace(x + i * size, logsize);
+  fft_raw_range(x, x + count * size, logsize);
+}
+
+void fft_inverse_inplace(fft_complex_t *x, size_t logsize) {
+  size_t size = (size_t)1 << logsize;
+  /* x[n] = (1 / N) * DFT(X)[-n mod N], so reverse the spectrum and transform forward */
+  for (size_t i = 1, j = size - 1; i < j; ++i, --j)
+    FFT_COMPLEX_SWAP(x[i], x[j]);
+  fft_inplace(x, logsize);
+  float scale = 1.0f / size;
+  for (size_t i = 0; i < size; ++i) {
+    x[i].real *= scale;
+    x[i].imag *= scale;
+  }
+}
+
+void fft_real(const float *restrict x, fft_complex_t *restrict X, size_t logsize) {
+  size_t half = (size_t)1 << (logsize - 1);
+  /* z[n] = x[2n] + i * x[2n + 1] */
+  for (size_t n = 0; n < half; ++n) {
+    X[n].real = x[2 * n];
+    X[n].imag = x[2 * n + 1];
+  }
+  fft_inplace(X, logsize - 1);
+
+  fft_complex_t z0 = X[0];
+  X[0].real = z0.real + z0.imag;
+  X[0].imag = 0.0f;
+  X[half].real = z0.real - z0.imag;
+  X[half].imag = 0.0f;
+
+  /* X[k] = E[k] + w^k * O[k], with E, O recovered from Z[k] and conj(Z[half - k]) */
+  fft_complex_t unit, root;
+  FFT_COMPLEX_UNITROOT_RECIP(unit, half * 2);
+  FFT_COMPLEX_COPY(root, unit);
+  for (size_t k = 1, j = half - 1; k <= j; ++k, --j) {
+    fft_complex_t zk = X[k], zj = X[j];
+    fft_complex_t even = { 0.5f * (zk.real + zj.real), 0.5f * (zk.imag - zj.imag) };
+    fft_complex_t odd = { 0.5f * (zk.imag + zj.imag), -0.5f * (zk.real - zj.real) };
+    fft_complex_t t;
+    FFT_COMPLEX_MUL(t, root, odd);
+    FFT_COMPLEX_ADD(X[k], even, t);
+    /* X[half - k] = conj(E[k] - w^k * O[k]) */
+    X[j].real = even.real - t.real;
+    X[j].imag = t.imag - even.imag;
+    FFT_COMPLEX_SELFMUL(root, unit);
+  }
+}
+
+void fft_real_inverse(fft_complex_t *restrict X, float *restrict x, size_t logsize) {
+  size_t half = (size_t)1 << (logsize - 1);
+
+  fft_complex_t x0 = X[0], xh = X[half];
+  X[0].real = 0.5f * (x0.real + xh.real);
+  X[0].imag = 0.5f * (x0.real - xh.real);
+
+  /* Z[k] = E[k] + i * O[k], the exact reverse of the step in fft_real() */
+  fft_complex_t unit, root;
+  FFT_COMPLEX_UNITROOT_RECIP(unit, half * 2);
+  unit.imag = -unit.imag;
+  FFT_COMPLEX_COPY(root, unit);
+  for (size_t k = 1, j = half - 1; k <= j; ++k, --j) {
+    fft_complex_t xk = X[k], xj = X[j];
+    fft_complex_t even = { 0.5f * (xk.real + xj.real), 0.5f * (xk.imag - xj.imag) };
+    fft_complex_t diff = { 0.5f * (xk.real - xj.real), 0.5f * (xk.imag + xj.imag) };
+    fft_complex_t odd;
+    FFT_COMPLEX_MUL(odd, root, diff);
+    X[k].real = even.real - odd.imag;
+    X[k].imag = even.imag + odd.real;
+    X[j].real = even.real + odd.imag;
+    X[j].imag = odd.real - even.imag;
+    FFT_COMPLEX_SELFMUL(root, unit);
+  }
+
+  fft_inverse_inplace(X, logsize - 1);
+  for (size_t n = 0; n < half; ++n) {
+    x[2 * n] = X[n].real;
+    x[2 * n + 1] = X[n].imag;
+  }
+}
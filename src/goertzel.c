@@ -0,0 +1,150 @@
+#include "goertzel.h"
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if defined (__SSE__) || defined (_M_X64)
+#include <xmmintrin.h>
+#define GOERTZEL_SSE
+#elif defined (__ARM_NEON)
+#include <arm_neon.h>
+#define GOERTZEL_NEON
+#endif
+
+/* nanoseconds per step of a lane group (GOERTZEL_LANES bins, one sample) and per butterfly of
+ * fft_real(), timed over 2 ^ 10 to 2 ^ 16 samples at -O3 on a 2.1 GHz x86-64 xeon: 3.8 to 4.2
+ * and 3.4 to 3.8. only their ratio matters, a faster or slower machine moves both about alike */
+#define GOERTZEL_STEP_COST      4.0
+#define GOERTZEL_BUTTERFLY_COST 3.6
+
+static void *goertzel_alloc(size_t size) {
+  void *ptr = malloc(size);
+  if (!ptr) {
+    fprintf(stderr, "failed to allocate memory\n");
+    exit(EXIT_FAILURE);
+  }
+  return ptr;
+}
+
+void goertzel_init(struct goertzel_bank *bank, const float *frequencies, size_t nbin, unsigned int rate) {
+  size_t npadded = (nbin + GOERTZEL_LANES - 1) / GOERTZEL_LANES * GOERTZEL_LANES;
+  bank->nbin = nbin;
+  bank->npadded = npadded;
+  bank->coeff = goertzel_alloc(sizeof (bank->coeff[0]) * npadded);
+  bank->s1 = goertzel_alloc(sizeof (bank->s1[0]) * npadded);
+  bank->s2 = goertzel_alloc(sizeof (bank->s2[0]) * npadded);
+  for (size_t i = 0; i < npadded; ++i)
+    bank->coeff[i] = i < nbin ? 2 * cos(2 * M_PI * frequencies[i] / rate) : 0.0f;
+  goertzel_reset(bank);
+}
+
+void goertzel_deinit(struct goertzel_bank *bank) {
+  free(bank->coeff);
+  free(bank->s1);
+  free(bank->s2);
+}
+
+void goertzel_reset(struct goertzel_bank *bank) {
+  memset(bank->s1, 0, sizeof (bank->s1[0]) * bank->npadded);
+  memset(bank->s2, 0, sizeof (bank->s2[0]) * bank->npadded);
+  bank->nsample = 0;
+}
+
+/* GOERTZEL_LANES bins over 'n' samples, the state stays in registers for the whole block */
+static void goertzel_group(const float *coeff, float *s1, float *s2, const float *x, size_t n) {
+#if defined (GOERTZEL_SSE)
+  __m128 c[GOERTZEL_LANES / 4], a[GOERTZEL_LANES / 4], b[GOERTZEL_LANES / 4];
+  for (size_t v = 0; v < GOERTZEL_LANES / 4; ++v) {
+    c[v] = _mm_loadu_ps(coeff + 4 * v);
+    a[v] = _mm_loadu_ps(s1 + 4 * v);
+    b[v] = _mm_loadu_ps(s2 + 4 * v);
+  }
+  for (size_t i = 0; i < n; ++i) {
+    __m128 sample = _mm_set1_ps(x[i]);
+    for (size_t v = 0; v < GOERTZEL_LANES / 4; ++v) {
+      __m128 s0 = _mm_sub_ps(_mm_add_ps(sample, _mm_mul_ps(c[v], a[v])), b[v]);
+      b[v] = a[v];
+      a[v] = s0;
+    }
+  }
+  for (size_t v = 0; v < GOERTZEL_LANES / 4; ++v) {
+    _mm_storeu_ps(s1 + 4 * v, a[v]);
+    _mm_storeu_ps(s2 + 4 * v, b[v]);
+  }
+#elif defined (GOERTZEL_NEON)
+  float32x4_t c[GOERTZEL_LANES / 4], a[GOERTZEL_LANES / 4], b[GOERTZEL_LANES / 4];
+  for (size_t v = 0; v < GOERTZEL_LANES / 4; ++v) {
+    c[v] = vld1q_f32(coeff + 4 * v);
+    a[v] = vld1q_f32(s1 + 4 * v);
+    b[v] = vld1q_f32(s2 + 4 * v);
+  }
+  for (size_t i = 0; i < n; ++i) {
+    float32x4_t sample = vdupq_n_f32(x[i]);
+    for (size_t v = 0; v < GOERTZEL_LANES / 4; ++v) {
+      float32x4_t s0 = vsubq_f32(vmlaq_f32(sample, c[v], a[v]), b[v]);
+      b[v] = a[v];
+      a[v] = s0;
+    }
+  }
+  for (size_t v = 0; v < GOERTZEL_LANES / 4; ++v) {
+    vst1q_f32(s1 + 4 * v, a[v]);
+    vst1q_f32(s2 + 4 * v, b[v]);
+  }
+#else
+  float c[GOERTZEL_LANES], a[GOERTZEL_LANES], b[GOERTZEL_LANES];
+  memcpy(c, coeff, sizeof (c));
+  memcpy(a, s1, sizeof (a));
+  memcpy(b, s2, sizeof (b));
+  for (size_t i = 0; i < n; ++i) {
+    for (size_t l = 0; l < GOERTZEL_LANES; ++l) {
+      float s0 = x[i] + c[l] * a[l] - b[l];
+      b[l] = a[l];
+      a[l] = s0;
+    }
+  }
+  memcpy(s1, a, sizeof (a));
+  memcpy(s2, b, sizeof (b));
+#endif
+}
+
+void goertzel_feed(struct goertzel_bank *bank, const float *x, size_t n) {
+  /* the recurrence is serial in time, so vectorize across bins instead */
+  for (size_t b = 0; b < bank->npadded; b += GOERTZEL_LANES)
+    goertzel_group(bank->coeff + b, bank->s1 + b, bank->s2 + b, x, n);
+  bank->nsample += n;
+}
+
+void goertzel_power(const struct goertzel_bank *bank, float *power) {
+  /* the phase term of non-integer bins cancels out in the magnitude */
+  for (size_t i = 0; i < bank->nbin; ++i) {
+    float s1 = bank->s1[i], s2 = bank->s2[i];
+    power[i] = s1 * s1 + s2 * s2 - bank->coeff[i] * s1 * s2;
+  }
+}
+
+void goertzel_evaluate(struct goertzel_bank *bank, const float *x, size_t n, float *power) {
+  goertzel_reset(bank);
+  goertzel_feed(bank, x, n);
+  goertzel_power(bank, power);
+}
+
+double goertzel_cost(size_t nbin, size_t n) {
+  size_t ngroup = (nbin + GOERTZEL_LANES - 1) / GOERTZEL_LANES;
+  return GOERTZEL_STEP_COST * ngroup * n;
+}
+
+double goertzel_fft_cost(size_t n) {
+  size_t logsize = 1;
+  while (((size_t)1 << logsize) < n)
+    ++logsize;
+  /* fft_real(): a half size fft_inplace() of log2(N / 2) passes of N / 4 butterflies and a bit
+   * reversal pass, plus the packing and the split into N / 2 bins, each counted as a butterfly */
+  double half = (double)((size_t)1 << (logsize - 1));
+  return GOERTZEL_BUTTERFLY_COST * (half / 2 * (logsize - 1) + 2 * half);
+}
+
+bool goertzel_beats_fft(size_t nbin, size_t n) {
+  return goertzel_cost(nbin, n) < goertzel_fft_cost(n);
+}
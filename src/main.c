@@ -8,14 +8,24 @@
 #include "minimp3/minimp3.h"
 #include "minimp3/minimp3_ex.h"
 #include "audio.h"
+#include "czt.h"
+#include "decode.h"
 #include "fft.h"
+#include "goertzel.h"
+#include "multires.h"
+#include "onset.h"
+#include "pitch.h"
+#include "playlist.h"
+#include "psd.h"
+#include "scan.h"
+#include "spectrogram.h"
 
-#include <limits.h>
 #include <pthread.h>
 #include <stdbool.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/stat.h>
 
 #ifndef ARRAYSIZE
 #define ARRAYSIZE(arr)    (sizeof (arr) / sizeof ((arr)[0]))
@@ -29,6 +39,48 @@
 #define FFT_SIZE      ((size_t)1 << FFT_LOGSIZE)
 #define FFT_NFREQ     (FFT_SIZE / 2 + 1)
 
+/* zoomed view: FFT_NFREQ bins over [ZOOM_MIN_HZ, ZOOM_MAX_HZ] from a longer window,
+ * so the band gets real resolution without raising FFT_LOGSIZE */
+#define ZOOM_LOGSIZE  13
+#define ZOOM_SIZE     ((size_t)1 << ZOOM_LOGSIZE)
+#define ZOOM_MIN_HZ   40.0f
+#define ZOOM_MAX_HZ   200.0f
+
+/* multi-resolution view: long windows for the bass, short ones for transients */
+#define MULTIRES_WINDOWS  { 8192, 2048, 512 }
+#define MULTIRES_EDGES    { 250.0f, 2000.0f }
+
+/* arrow keys jump this far, holding them scrubs */
+#define SEEK_STEP_SECONDS 5
+
+/* frame time assumed before any frame is measured, and how fast the measurement follows */
+#define FRAME_INTERVAL    (1.0 / 60)
+#define FRAME_SMOOTHING   0.1
+
+/* decoded audio a track waits for before the device starts, the rest follows in the background */
+#define STARTUP_LEAD_MS   200
+
+/* largest output buffering '--latency' takes, a track's rate may lower it further */
+#define LATENCY_MAX_MS    10000
+/* the visuals trail the decoder by the output buffering, and what they read has to be still in the
+ * stream history. besides the buffer of four periods that takes a period of slack and the widest
+ * window (ZOOM_SIZE, as wide as HUM_SIZE and the widest multires window) */
+#define LATENCY_LIMIT_FRAMES  ((STREAM_HISTORY - ZOOM_SIZE) * 4 / 5)
+
+/* how fast the beat flash fades, per rendered frame */
+#define BEAT_DECAY    0.85f
+/* how often the tempo in the title is estimated again from the onset history */
+#define TEMPO_INTERVAL_SECONDS  1
+
+/* mains hum: the first harmonics of 50 and 60 Hz against the bins halfway between them,
+ * over enough frames that the two are several bins apart */
+#define HUM_LOGSIZE   13
+#define HUM_SIZE      ((size_t)1 << HUM_LOGSIZE)
+#define HUM_HARMONICS 4
+#define HUM_NBIN      (2 * 2 * HUM_HARMONICS)
+#define HUM_RATIO_DB  10.0f
+#define HUM_MIN_DB    -90.0f
+
 #define POSITION_LOCATION 0
 #define COLOR_LOCATION    1
 
@@ -42,6 +94,12 @@
   }                                                                     \
 } while (0)
 
+enum view {
+  VIEW_SPECTRUM,
+  VIEW_ZOOM,
+  VIEW_MULTIRES,
+};
+
 struct point {
   float x;
   float y;
@@ -51,10 +109,46 @@ struct context {
   GLuint VAO;
   GLuint VBO;
   GLuint program;
-  mp3dec_t mp3dec;
-  mp3dec_file_info_t mp3fileinfo;
+  struct pcm_stream streams[2];
+  struct pcm_stream *stream;  /* the track being heard */
+  struct pcm_stream *ahead;   /* the next track, decoding in the other slot while 'stream' plays out */
+  struct playlist playlist;
+  size_t track;               /* playlist index of 'stream' */
+  size_t aheadtrack;
+  size_t nexttrack;           /* first playlist entry not opened yet */
+  size_t trackstart;          /* device frame where 'stream' starts */
+  const char *device;
+  unsigned int latency_ms;    /* asked of the device, 0 for its default */
+  double starttime;           /* time to first sound is measured from here */
   struct audio_desc audio;
+  size_t nframe;          /* track length from the frame headers, 0 if unknown */
+  bool seekpending;       /* applied once per rendered frame, so dragging does not restart the device per event */
+  size_t seekto;
+  bool scrubbing;         /* left mouse button held in the window */
   fft_complex_t (*fftbuffers)[FFT_SIZE];
+  float (*amplitudes)[FFT_NFREQ];
+  enum view view;
+  struct spectrogram spectrogram;
+  bool hasspectrogram;    /* precomputed by --spectrogram, looked up instead of transformed */
+  struct czt_plan zoom;
+  struct multires *multires;
+  size_t multirespos;
+  struct onset_detector onset;
+  size_t onsetpos;
+  float beat;
+  float tempo;            /* bpm, 0 until there is enough onset history */
+  size_t tempoframe;      /* onset frames analysed at the last estimate */
+  struct pitch_tracker pitch;
+  size_t pitchpos;        /* start of the next window to estimate */
+  float *pitches;         /* latest estimate of each channel */
+  struct goertzel_bank hum;
+  bool humfft;            /* the bins come cheaper out of fft_real(), see goertzel_beats_fft() */
+  float *humwindow;
+  float *humframe;        /* windowed mono mix of HUM_SIZE frames */
+  fft_complex_t *humspectrum;
+  size_t humpos;
+  unsigned int humhz;     /* mains frequency heard, 0 for none */
+  float humlevel;         /* of its harmonics together, in dBFS */
   struct {
     struct point a1;
     struct point a2;
@@ -65,20 +159,77 @@ struct context {
   } *blocks;
 };
 
-static void context_init(struct context *context, const char *music, const char *vspath, const char *fspath);
+static void context_init(struct context *context, const char *vspath, const char *fspath);
 static void context_deinit(struct context *context);
-static void prepare_data(struct context *context, const char *music);
+static void prepare_data(struct context *context);
+static void prepare_analysis(struct context *context);
+static void release_analysis(struct context *context);
+static void prefetch_track(struct context *context);
+static void advance_track(struct context *context, size_t trackstart);
+static void take_back_track(struct context *context);
 static void prepare_program(struct context *context, const char *vspath, const char *fspath);
 static void render(struct context *context, size_t currpos);
 static void play_audio(struct context *context, const char *params);
 static void window_resize_callback(GLFWwindow* window, int width, int height);
+static void key_callback(GLFWwindow *window, int key, int scancode, int action, int mods);
+static void mouse_button_callback(GLFWwindow *window, int button, int action, int mods);
+static void cursor_pos_callback(GLFWwindow *window, double x, double y);
+static void update_title(GLFWwindow *window, struct context *context);
+static int print_tempo(int nfile, char **files);
+static int print_psd(int nfile, char **files);
+static int build_spectrograms(int nfile, char **files);
+static int print_scan(int nfile, char **files);
 
 int main(int argc, char **argv) {
+  double starttime = audio_now();
   if (argc <= 1) {
     fprintf(stderr, "you must provide mp3 file path\n");
     return EXIT_FAILURE;
   }
 
+  if (strcmp(argv[1], "--tempo") == 0)
+    return print_tempo(argc - 2, argv + 2);
+  if (strcmp(argv[1], "--psd") == 0)
+    return print_psd(argc - 2, argv + 2);
+  if (strcmp(argv[1], "--spectrogram") == 0)
+    return build_spectrograms(argc - 2, argv + 2);
+  if (strcmp(argv[1], "--scan") == 0)
+    return print_scan(argc - 2, argv + 2);
+
+  /* '--latency <ms>' ahead of the files sets the output buffering */
+  int first = 1;
+  unsigned int latency_ms = 0;
+  if (argc > 3 && strcmp(argv[1], "--latency") == 0) {
+    char *end;
+    unsigned long ms = strtoul(argv[2], &end, 10);
+    if (end == argv[2] || *end != '\0' || argv[2][0] == '-' || ms == 0 || ms > LATENCY_MAX_MS) {
+      fprintf(stderr, "invalid latency: %s, expected 1 to %d ms\n", argv[2], LATENCY_MAX_MS);
+      return EXIT_FAILURE;
+    }
+    latency_ms = (unsigned int)ms;
+    first = 3;
+  }
+
+  /* '<file> <device>' still works: a last argument that is not a file names the device */
+  struct stat st;
+  int nfile = argc - first;
+  const char *device = NULL;
+  if (nfile > 1 && stat(argv[argc - 1], &st) && !source_special(argv[argc - 1])) {
+    device = argv[argc - 1];
+    --nfile;
+  }
+  struct playlist playlist;
+  playlist_init(&playlist);
+  for (int i = first; i < first + nfile; ++i) {
+    if (!playlist_add(&playlist, argv[i]))
+      fprintf(stderr, "failed to read playlist: %s\n", argv[i]);
+  }
+  if (playlist.npath == 0) {
+    fprintf(stderr, "nothing to play\n");
+    playlist_free(&playlist);
+    return EXIT_FAILURE;
+  }
+
   glfwInit();
   glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 4);
   glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 6);
@@ -92,40 +243,114 @@ int main(int argc, char **argv) {
 
   glfwMakeContextCurrent(window);
   glfwSetWindowSizeCallback(window, window_resize_callback);
+  glfwSetKeyCallback(window, key_callback);
+  glfwSetMouseButtonCallback(window, mouse_button_callback);
+  glfwSetCursorPosCallback(window, cursor_pos_callback);
 
   GL_CALL(gladLoadGL());
 
   struct context context;
-  context_init(&context, argv[1], "resources/vs.glsl", "resources/fs.glsl");
+  context.playlist = playlist;
+  context.device = device;
+  context.latency_ms = latency_ms;
+  context.starttime = starttime;
+  context_init(&context, "resources/vs.glsl", "resources/fs.glsl");
+  glfwSetWindowUserPointer(window, &context);
 
   glClearColor(0.0, 0.0, 0.0, 1.0);
-  play_audio(&context, argc > 2 ? argv[2] : NULL);
+  play_audio(&context, context.device);
 
   size_t audiopos = 0;
   audiopos = audio_getpos(&context.audio);
-  while (!glfwWindowShouldClose(window) && !audio_end(&context.audio)) {
-    render(&context, audiopos);
+  bool reported = false;
+  int status = EXIT_SUCCESS;
+  double interval = FRAME_INTERVAL, swaptime = audio_now();
+  while (!glfwWindowShouldClose(window)) {
+    /* what is drawn now shows at the next swap, so analyse the sample heard then */
+    size_t renderpos = audio_clock(&context.audio, audio_now() + interval);
+    render(&context, renderpos > context.trackstart ? renderpos - context.trackstart : 0);
+    update_title(window, &context);
     glfwSwapBuffers(window);
+    double now = audio_now();
+    if (now - swaptime < 4 * interval + FRAME_INTERVAL)
+      interval += (now - swaptime - interval) * FRAME_SMOOTHING;
+    swaptime = now;
     glfwPollEvents();
+    /* a pipe plays through */
+    if (context.seekpending && stream_seekable(context.stream)) {
+      audio_lock(&context.audio);
+      if (stream_seekable(context.audio.stream)) {
+        if (context.audio.stream != context.stream)
+          take_back_track(&context);
+        audio_seek(&context.audio, context.seekto);
+      }
+      audio_unlock(&context.audio);
+    }
+    context.seekpending = false;
+    prefetch_track(&context);
+    if (audio_end(&context.audio)) {
+      if (!context.ahead)
+        break;
+      /* a wav file has one format throughout, reopening would start it over and lose what is written */
+      if (context.audio.sink.kind == SINK_WAV) {
+        fprintf(stderr, "wav file is %u Hz %d channels, %s is %u Hz %d channels: stopping before it\n",
+                context.audio.rate, context.audio.nchannel, context.playlist.paths[context.aheadtrack],
+                context.ahead->rate, context.ahead->nchannel);
+        status = EXIT_FAILURE;
+        break;
+      }
+      /* the next track has another format, the device is reopened for it */
+      audio_free(&context.audio);
+      advance_track(&context, 0);
+      context.starttime = audio_now();
+      play_audio(&context, context.device);
+    }
     audio_continue(&context.audio);
     audiopos = audio_getpos(&context.audio);
+    if (!reported && context.audio.first_sound >= 0.0) {
+      fprintf(stderr, "time to first sound: %.1f ms\n", context.audio.first_sound * 1000);
+      reported = true;
+    }
+    /* the device reached the track it moved on to */
+    audio_lock(&context.audio);
+    bool reached = context.audio.stream != context.stream && audiopos >= context.audio.trackstart;
+    size_t trackstart = context.audio.trackstart;
+    audio_unlock(&context.audio);
+    if (reached)
+      advance_track(&context, trackstart);
   }
 
+  if (context.audio.nseek)
+    fprintf(stderr, "seek to first sound: %zu seeks, mean %.1f ms, max %.1f ms\n", context.audio.nseek,
+            context.audio.seek_latency_sum / context.audio.nseek * 1000, context.audio.seek_latency_max * 1000);
+  if (atomic_load(&context.audio.nxrun))
+    fprintf(stderr, "underruns: %zu\n", atomic_load(&context.audio.nxrun));
   context_deinit(&context);
   glfwDestroyWindow(window);
 
   glfwTerminate();
-  return EXIT_SUCCESS;
+  return status;
+}
+
+static inline float complex_mod(fft_complex_t complex) {
+  return sqrtf(complex.real * complex.real + complex.imag * complex.imag);
 }
 
 static void do_fft(struct context *context, size_t currpos) {
   /* prepare data */
   size_t nchannel = context->audio.nchannel;
-  const mp3d_sample_t *buffer = context->audio.data + currpos * nchannel;
-
-  if ((currpos + FFT_SIZE) * nchannel > context->audio.samples)
+  if (context->hasspectrogram) {
+    bool found = true;
+    for (size_t channel = 0; channel < nchannel && found; ++channel)
+      found = spectrogram_frame(&context->spectrogram, currpos, channel, context->amplitudes[channel]);
+    if (found)
+      return;
+  }
+  if (!stream_has(context->stream, currpos, FFT_SIZE))
     return;
 
+  const mp3d_sample_t *buffer = stream_at(context->stream, currpos);
+
   for (size_t channel = 0; channel < nchannel; ++channel) {
     for (size_t i = 0; i < FFT_SIZE; ++i) {
       context->fftbuffers[channel][i].real = buffer[i * nchannel + channel];
@@ -134,10 +359,36 @@ static void do_fft(struct context *context, size_t currpos) {
   }
   for (size_t channel = 0; channel < nchannel; ++channel)
     fft_inplace(context->fftbuffers[channel], FFT_LOGSIZE);
+
+  const float divisor = 0.7f * DECODE_SAMPLE_SCALE;
+  for (size_t channel = 0; channel < nchannel; ++channel) {
+    fft_complex_t *fft_result = context->fftbuffers[channel];
+    float *amplitudes = context->amplitudes[channel];
+    for (size_t j = 0; j < FFT_NFREQ; ++j)
+      amplitudes[j] = complex_mod(fft_result[j]) * 2 / FFT_SIZE / divisor;
+    /* fix 0 and FFT_SIZE / 2 */
+    amplitudes[0] /= 2;
+    if (FFT_SIZE / 2 < FFT_NFREQ)
+      amplitudes[FFT_SIZE / 2] /= 2;
+  }
 }
 
-static inline float complex_mod(fft_complex_t complex) {
-  return sqrtf(complex.real * complex.real + complex.imag * complex.imag);
+static void do_zoom(struct context *context, size_t currpos) {
+  size_t nchannel = context->audio.nchannel;
+  if (!stream_has(context->stream, currpos, ZOOM_SIZE))
+    return;
+
+  const mp3d_sample_t *buffer = stream_at(context->stream, currpos);
+
+  /* the hann window has a coherent gain of 1 / 2 */
+  const float divisor = 0.7f * DECODE_SAMPLE_SCALE;
+  for (size_t channel = 0; channel < nchannel; ++channel) {
+    /* FFT_SIZE >= FFT_NFREQ, so the zoomed bins fit in the fft buffers */
+    fft_complex_t *zoom_result = context->fftbuffers[channel];
+    czt_transform_pcm(&context->zoom, buffer, nchannel, channel, zoom_result);
+    for (size_t j = 0; j < FFT_NFREQ; ++j)
+      context->amplitudes[channel][j] = complex_mod(zoom_result[j]) * 4 / ZOOM_SIZE / divisor;
+  }
 }
 
 static void render_allchannels(struct context *context) {
@@ -149,11 +400,11 @@ static void render_allchannels(struct context *context) {
     GL_CALL(glUniform1f(total_channel_uniform, (float)context->audio.nchannel));
     GLint channel_uniform = glGetUniformLocation(context->program, "channel");
     GL_CALL(glUniform1f(channel_uniform, (float)i));
+    GLint beat_uniform = glGetUniformLocation(context->program, "beat");
+    GL_CALL(glUniform1f(beat_uniform, context->beat));
 
-    fft_complex_t *fft_result = context->fftbuffers[i];
-    const float divisor = (0.7) * ((size_t)1 << sizeof (mp3d_sample_t) * CHAR_BIT) / 2;
     for (size_t j = 0; j < FFT_NFREQ; ++j) {
-      float amplitude = complex_mod(fft_result[j]) * 2 / FFT_SIZE / divisor;
+      float amplitude = context->amplitudes[i][j];
       context->blocks[j].a1.x = (float)j / FFT_NFREQ;
       context->blocks[j].a1.y = 0;
       context->blocks[j].a2.x = (float)(j + 1) / FFT_NFREQ;
@@ -165,15 +416,6 @@ static void render_allchannels(struct context *context) {
       context->blocks[j].b3.x = (float)(j + 1) / FFT_NFREQ;
       context->blocks[j].b3.y = amplitude;
     }
-    /* fix 0 and FFT_SIZE / 2 */
-    context->blocks[0].a3.y /= 2;
-    context->blocks[0].b3.y /= 2;
-    context->blocks[0].b2.y /= 2;
-    if (FFT_SIZE / 2 < FFT_NFREQ) {
-      context->blocks[FFT_SIZE / 2].a3.y /= 2;
-      context->blocks[FFT_SIZE / 2].b3.y /= 2;
-      context->blocks[FFT_SIZE / 2].b2.y /= 2;
-    }
     GL_CALL(glBindBuffer(GL_ARRAY_BUFFER, context->VBO));
     GL_CALL(glBufferSubData(GL_ARRAY_BUFFER, 0, sizeof (context->blocks[0]) * FFT_NFREQ, context->blocks));
     GL_CALL(glDrawArrays(GL_TRIANGLES, 0, FFT_NFREQ * 6));
@@ -181,14 +423,149 @@ static void render_allchannels(struct context *context) {
   }
 }
 
+static void detect_onset(struct context *context, size_t currpos) {
+  struct pcm_stream *stream = context->stream;
+  size_t nchannel = stream->nchannel;
+  /* frames already dropped from the ring are skipped */
+  if (currpos < context->onsetpos || !stream_has(stream, context->onsetpos, currpos - context->onsetpos))
+    context->onsetpos = currpos;
+
+  size_t nonset = 0;
+  while (context->onsetpos < currpos) {
+    size_t n = currpos - context->onsetpos > STREAM_SPAN ? STREAM_SPAN : currpos - context->onsetpos;
+    nonset += onset_feed(&context->onset, stream_at(stream, context->onsetpos), n, nchannel);
+    context->onsetpos += n;
+  }
+  context->beat = nonset ? 1.0f : context->beat * BEAT_DECAY;
+  if (context->onset.nframe - context->tempoframe >= (size_t)stream->rate * TEMPO_INTERVAL_SECONDS / ONSET_HOP) {
+    context->tempo = onset_tempo(&context->onset);
+    context->tempoframe = context->onset.nframe;
+  }
+}
+
+static void detect_pitch(struct context *context, size_t currpos) {
+  struct pcm_stream *stream = context->stream;
+  size_t nchannel = stream->nchannel;
+  /* a seek either way restarts the hops at the current frame, a slow frame rate is caught up with */
+  if (currpos + PITCH_HOP < context->pitchpos || context->pitchpos + STREAM_SPAN < currpos)
+    context->pitchpos = currpos;
+
+  /* every hop up to the current frame, the window reaching ahead of it as it is heard */
+  while (context->pitchpos <= currpos && stream_has(stream, context->pitchpos, (size_t)1 << PITCH_LOGSIZE)) {
+    const mp3d_sample_t *buffer = stream_at(stream, context->pitchpos);
+    for (size_t channel = 0; channel < nchannel; ++channel)
+      context->pitches[channel] = pitch_detect_pcm(&context->pitch, buffer, nchannel, channel, NULL);
+    context->pitchpos += PITCH_HOP;
+  }
+}
+
+/* the harmonics of 50 Hz, the bins between them, then the same for 60 Hz */
+static float hum_frequency(size_t k) {
+  float mains = k < HUM_NBIN / 2 ? 50.0f : 60.0f;
+  size_t h = k % HUM_HARMONICS;
+  bool between = k % (2 * HUM_HARMONICS) >= HUM_HARMONICS;
+  return mains * (h + (between ? 1.5f : 1.0f));
+}
+
+static void measure_hum(struct context *context, const mp3d_sample_t *data) {
+  struct pcm_stream *stream = context->stream;
+  size_t nchannel = stream->nchannel;
+  for (size_t j = 0; j < HUM_SIZE; ++j) {
+    float sum = 0.0f;
+    for (size_t channel = 0; channel < nchannel; ++channel)
+      sum += data[j * nchannel + channel];
+    context->humframe[j] = sum / (nchannel * DECODE_SAMPLE_SCALE) * context->humwindow[j];
+  }
+
+  float power[HUM_NBIN];
+  if (context->humfft) {
+    fft_real(context->humframe, context->humspectrum, HUM_LOGSIZE);
+    for (size_t k = 0; k < HUM_NBIN; ++k) {
+      fft_complex_t bin = context->humspectrum[lrintf(hum_frequency(k) * HUM_SIZE / stream->rate)];
+      power[k] = bin.real * bin.real + bin.imag * bin.imag;
+    }
+  } else {
+    goertzel_evaluate(&context->hum, context->humframe, HUM_SIZE, power);
+  }
+
+  /* a full scale sine through the hann window comes out at a quarter of the frame */
+  const float fullscale = (float)HUM_SIZE / 4 * HUM_SIZE / 4;
+  float bestratio = 0.0f;
+  context->humhz = 0;
+  for (size_t m = 0; m < 2; ++m) {
+    const float *harmonics = power + m * 2 * HUM_HARMONICS, *between = harmonics + HUM_HARMONICS;
+    float tone = 0.0f, rest = 0.0f;
+    for (size_t h = 0; h < HUM_HARMONICS; ++h) {
+      tone += harmonics[h];
+      rest += between[h];
+    }
+    float ratio = 10.0f * log10f((tone + 1e-20f) / (rest + 1e-20f));
+    float level = 10.0f * log10f(tone / fullscale + 1e-20f);
+    /* the fundamental itself stands out too, a note an octave up only lands on the even harmonics */
+    bool fundamental = 10.0f * log10f((harmonics[0] + 1e-20f) / (between[0] + 1e-20f)) >= HUM_RATIO_DB;
+    if (fundamental && ratio >= HUM_RATIO_DB && level >= HUM_MIN_DB && ratio > bestratio) {
+      bestratio = ratio;
+      context->humhz = m ? 60 : 50;
+      context->humlevel = level;
+    }
+  }
+}
+
+/* every HUM_SIZE frames, as detect_pitch() does */
+static void detect_hum(struct context *context, size_t currpos) {
+  struct pcm_stream *stream = context->stream;
+  if (currpos + HUM_SIZE < context->humpos || context->humpos + STREAM_SPAN < currpos)
+    context->humpos = currpos;
+  while (context->humpos <= currpos && stream_has(stream, context->humpos, HUM_SIZE)) {
+    measure_hum(context, stream_at(stream, context->humpos));
+    context->humpos += HUM_SIZE;
+  }
+}
+
+static void do_multires(struct context *context, size_t currpos) {
+  struct pcm_stream *stream = context->stream;
+  size_t nchannel = stream->nchannel;
+  /* analyse up to the newest sample do_fft() would look at */
+  size_t written = stream_written(stream);
+  size_t endpos = currpos + FFT_SIZE > written ? written : currpos + FFT_SIZE;
+  size_t maxwindow = MULTIRES_SIZE << context->multires[0].nlevel;
+  if (endpos < context->multirespos || endpos - context->multirespos > maxwindow)
+    context->multirespos = endpos > maxwindow ? endpos - maxwindow : 0;
+  if (!stream_has(stream, context->multirespos, endpos - context->multirespos))
+    return;
+
+  const float divisor = 0.7f * DECODE_SAMPLE_SCALE;
+  for (size_t channel = 0; channel < nchannel; ++channel) {
+    struct multires *mr = &context->multires[channel];
+    for (size_t pos = context->multirespos; pos < endpos; pos += STREAM_SPAN) {
+      size_t n = endpos - pos > STREAM_SPAN ? STREAM_SPAN : endpos - pos;
+      multires_feed(mr, stream_at(stream, pos), n, nchannel, channel);
+    }
+    multires_analyze(mr);
+    float *amplitudes = context->amplitudes[channel];
+    multires_resample(mr, amplitudes, FFT_NFREQ, (float)context->audio.rate * FFT_NFREQ / FFT_SIZE);
+    for (size_t j = 0; j < FFT_NFREQ; ++j)
+      amplitudes[j] /= divisor;
+  }
+  context->multirespos = endpos;
+}
+
 static void render(struct context *context, size_t currpos) {
   GL_CALL(glClear(GL_COLOR_BUFFER_BIT));
-  do_fft(context, currpos);
+  if (context->view == VIEW_ZOOM)
+    do_zoom(context, currpos);
+  else if (context->view == VIEW_MULTIRES)
+    do_multires(context, currpos);
+  else
+    do_fft(context, currpos);
+  detect_onset(context, currpos);
+  detect_pitch(context, currpos);
+  detect_hum(context, currpos);
   render_allchannels(context);
 }
 
-static void context_init(struct context *context, const char *music, const char *vspath, const char *fspath) {
-  prepare_data(context, music);
+static void context_init(struct context *context, const char *vspath, const char *fspath) {
+  prepare_data(context);
   prepare_program(context, vspath, fspath);
 }
 
@@ -197,10 +574,76 @@ static void context_deinit(struct context *context) {
   GL_CALL(glDeleteBuffers(1, &context->VBO));
   GL_CALL(glDeleteVertexArrays(1, &context->VAO));
   audio_free(&context->audio);
+  release_analysis(context);
+  stream_close(context->stream);
+  if (context->ahead)
+    stream_close(context->ahead);
+  playlist_free(&context->playlist);
+  free(context->blocks);
+}
+
+static void release_analysis(struct context *context) {
+  onset_deinit(&context->onset);
+  pitch_deinit(&context->pitch);
+  czt_deinit(&context->zoom);
+  if (context->hasspectrogram)
+    spectrogram_close(&context->spectrogram);
+  for (int i = 0; i < context->stream->nchannel; ++i)
+    multires_deinit(&context->multires[i]);
 
-  free(context->mp3fileinfo.buffer);
   free(context->fftbuffers);
-  free(context->blocks);
+  free(context->amplitudes);
+  free(context->multires);
+  free(context->pitches);
+  goertzel_deinit(&context->hum);
+  free(context->humwindow);
+  free(context->humframe);
+  free(context->humspectrum);
+}
+
+/* open the next playlist entry that loads into 'stream', returns false when the playlist is exhausted */
+static bool open_next_track(struct context *context, struct pcm_stream *stream, size_t *track) {
+  while (context->nexttrack < context->playlist.npath) {
+    const char *path = context->playlist.paths[context->nexttrack++];
+    if (!stream_open(stream, path)) {
+      *track = context->nexttrack - 1;
+      return true;
+    }
+    fprintf(stderr, "failed to load file: %s\n", path);
+  }
+  return false;
+}
+
+/* once the current track is decoded to its end the next one starts decoding in the
+ * other slot, so it is buffered by the time the device gets there */
+static void prefetch_track(struct context *context) {
+  if (context->ahead || context->audio.stream != context->stream || !stream_decoded(context->stream))
+    return;
+  struct pcm_stream *slot = context->stream == &context->streams[0] ? &context->streams[1] : &context->streams[0];
+  if (!open_next_track(context, slot, &context->aheadtrack))
+    return;
+  context->ahead = slot;
+  audio_lock(&context->audio);
+  context->audio.next = slot;
+  audio_unlock(&context->audio);
+}
+
+static void advance_track(struct context *context, size_t trackstart) {
+  release_analysis(context);
+  stream_close(context->stream);
+  context->stream = context->ahead;
+  context->track = context->aheadtrack;
+  context->ahead = NULL;
+  context->trackstart = trackstart;
+  prepare_analysis(context);
+}
+
+/* the device has moved on to the next track but still plays this one, a seek here takes it back */
+static void take_back_track(struct context *context) {
+  context->audio.next = context->audio.stream;
+  context->audio.stream = context->stream;
+  context->audio.trackstart = context->trackstart;
+  stream_seek(context->audio.next, 0);
 }
 
 static void proccess_data(mp3d_sample_t *data, size_t nframe, size_t nchannel, size_t rate) {
@@ -241,38 +684,17 @@ static void proccess_data(mp3d_sample_t *data, size_t nframe, size_t nchannel, s
   free(tmpbuf);
 }
 
-static void prepare_data(struct context *context, const char *music) {
-  mp3dec_init(&context->mp3dec);
-  if (mp3dec_load(&context->mp3dec, music, &context->mp3fileinfo, NULL, NULL)) {
-    fprintf(stderr, "failed to load file: %s\n", music);
-    exit(EXIT_FAILURE);
-  }
-
-  // for (size_t i = 0; i < context->mp3fileinfo.samples; i += context->mp3fileinfo.channels) {
-  //   context->mp3fileinfo.buffer[i + 1] = context->mp3fileinfo.buffer[i];
-  // }
-
-  // for (size_t i = 0; i < context->mp3fileinfo.samples; i += context->mp3fileinfo.channels) {
-  //   size_t divisor = (UINT16_MAX + 1) / 256;
-  //   size_t volume = context->mp3fileinfo.buffer[i] + 32768;
-  //   volume /= divisor;
-  //   volume *= divisor;
-  //   context->mp3fileinfo.buffer[i] = (int)volume - 32768;
-  // }
-
-  // proccess_data(context->mp3fileinfo.buffer,
-  //               context->mp3fileinfo.samples / context->mp3fileinfo.channels,
-  //               context->mp3fileinfo.channels, context->mp3fileinfo.hz);
-
-  // proccess_data(context->mp3fileinfo.buffer + 1,
-  //               context->mp3fileinfo.samples / context->mp3fileinfo.channels,
-  //               context->mp3fileinfo.channels, context->mp3fileinfo.hz);
-
-  context->fftbuffers = malloc(sizeof (context->fftbuffers[0]) * context->mp3fileinfo.channels);
-  if (!context->fftbuffers) {
-    fprintf(stderr, "failed to allocate memory\n");
+static void prepare_data(struct context *context) {
+  context->nexttrack = 0;
+  if (!open_next_track(context, &context->streams[0], &context->track))
     exit(EXIT_FAILURE);
-  }
+  context->stream = &context->streams[0];
+  context->ahead = NULL;
+  context->trackstart = 0;
+  context->seekpending = false;
+  context->scrubbing = false;
+  context->view = VIEW_SPECTRUM;
+  prepare_analysis(context);
 
   context->blocks = malloc(FFT_NFREQ * sizeof (context->blocks[0]));
   if (!context->blocks) {
@@ -296,6 +718,76 @@ static void prepare_data(struct context *context, const char *music) {
   GL_CALL(glBindVertexArray(0));
 }
 
+/* everything that follows one track: the analysers and the precomputed spectrogram */
+static void prepare_analysis(struct context *context) {
+  context->fftbuffers = malloc(sizeof (context->fftbuffers[0]) * context->stream->nchannel);
+  if (!context->fftbuffers) {
+    fprintf(stderr, "failed to allocate memory\n");
+    exit(EXIT_FAILURE);
+  }
+
+  context->amplitudes = calloc(context->stream->nchannel, sizeof (context->amplitudes[0]));
+  if (!context->amplitudes) {
+    fprintf(stderr, "failed to allocate memory\n");
+    exit(EXIT_FAILURE);
+  }
+  /* an mp3 without a vbr tag tells its length only once its frames are counted */
+  struct scan_info info;
+  const struct source *source = &context->stream->source;
+  context->nframe = context->stream->frames ? context->stream->nframe : source->nframe;
+  if (!context->nframe && source->kind == SOURCE_MP3 && source->path && !scan_file(source->path, &info))
+    context->nframe = info.nframe;
+  context->hasspectrogram = context->stream->haskey &&
+                            spectrogram_open(&context->spectrogram, context->stream->key, FFT_LOGSIZE);
+  if (context->hasspectrogram && context->spectrogram.nchannel != context->stream->nchannel) {
+    spectrogram_close(&context->spectrogram);
+    context->hasspectrogram = false;
+  }
+  czt_init(&context->zoom, ZOOM_SIZE, FFT_NFREQ, ZOOM_MIN_HZ, ZOOM_MAX_HZ, context->stream->rate);
+
+  const size_t multires_windows[] = MULTIRES_WINDOWS;
+  const float multires_edges[] = MULTIRES_EDGES;
+  context->multires = malloc(sizeof (context->multires[0]) * context->stream->nchannel);
+  if (!context->multires) {
+    fprintf(stderr, "failed to allocate memory\n");
+    exit(EXIT_FAILURE);
+  }
+  for (int i = 0; i < context->stream->nchannel; ++i)
+    multires_init(&context->multires[i], context->stream->rate, multires_windows, multires_edges, ARRAYSIZE(multires_windows));
+  context->multirespos = 0;
+
+  onset_init(&context->onset, context->stream->rate, ONSET_LOGSIZE, ONSET_HOP);
+  context->onsetpos = 0;
+  context->beat = 0.0f;
+  context->tempo = 0.0f;
+  context->tempoframe = 0;
+
+  pitch_init(&context->pitch, context->stream->rate, PITCH_LOGSIZE);
+  context->pitchpos = 0;
+  context->pitches = calloc(context->stream->nchannel, sizeof (context->pitches[0]));
+  if (!context->pitches) {
+    fprintf(stderr, "failed to allocate memory\n");
+    exit(EXIT_FAILURE);
+  }
+
+  float frequencies[HUM_NBIN];
+  for (size_t k = 0; k < HUM_NBIN; ++k)
+    frequencies[k] = hum_frequency(k);
+  goertzel_init(&context->hum, frequencies, HUM_NBIN, context->stream->rate);
+  context->humfft = !goertzel_beats_fft(HUM_NBIN, HUM_SIZE);
+  context->humwindow = malloc(sizeof (context->humwindow[0]) * HUM_SIZE);
+  context->humframe = malloc(sizeof (context->humframe[0]) * HUM_SIZE);
+  context->humspectrum = context->humfft ? malloc(sizeof (context->humspectrum[0]) * (HUM_SIZE / 2 + 1)) : NULL;
+  if (!context->humwindow || !context->humframe || (context->humfft && !context->humspectrum)) {
+    fprintf(stderr, "failed to allocate memory\n");
+    exit(EXIT_FAILURE);
+  }
+  for (size_t j = 0; j < HUM_SIZE; ++j)
+    context->humwindow[j] = 0.5f - 0.5f * cosf(2 * M_PI * j / HUM_SIZE);
+  context->humpos = 0;
+  context->humhz = 0;
+}
+
 static char *read_full_file(const char *path) {
   FILE *f = fopen(path, "rb");
   if (!f) {
@@ -368,18 +860,224 @@ static void prepare_program(struct context *context, const char *vspath, const c
 }
 
 static void play_audio(struct context *context, const char *params) {
+  unsigned int latency_ms = context->latency_ms;
+  unsigned int limit_ms = (unsigned int)(LATENCY_LIMIT_FRAMES * 1000 / context->stream->rate);
+  if (latency_ms > limit_ms) {
+    fprintf(stderr, "latency %u ms is more than the visuals can trail %u Hz audio by, using %u ms\n",
+            latency_ms, context->stream->rate, limit_ms);
+    latency_ms = limit_ms;
+  }
   context->audio = (struct audio_desc) {
-    .nchannel = context->mp3fileinfo.channels,
-    .samples = context->mp3fileinfo.samples,
-    .rate = context->mp3fileinfo.hz,
-    .data = context->mp3fileinfo.buffer,
-    .avg_bitrate_kbps = context->mp3fileinfo.avg_bitrate_kbps,
+    .stream = context->stream,
+    .next = context->ahead,
+    .nchannel = context->stream->nchannel,
+    .rate = context->stream->rate,
+    .latency_ms = latency_ms,
+    .starttime = context->starttime,
+    .first_sound = -1.0,
   };
 
+  /* a short head start is enough, the decoder runs far faster than the device plays */
+  stream_wait(context->stream, (size_t)context->stream->rate * STARTUP_LEAD_MS / 1000);
+
   audio_play(&context->audio, params);
+  fprintf(stderr, "output latency: %.1f ms\n", context->audio.latency * 1000);
+  if (context->audio.latency * context->stream->rate > LATENCY_LIMIT_FRAMES)
+    fprintf(stderr, "the device buffers more than the visuals can trail, they stop while it plays\n");
 }
 
 static void window_resize_callback(GLFWwindow* window, int width, int height) {
   (void)window;
   glViewport(0, 0, width, height);
 }
+
+/* relative to a seek still pending, so repeated presses add up */
+static void seek_by(struct context *context, long long nframe) {
+  long long pos = context->seekpending ? (long long)context->seekto
+                                       : (long long)(audio_getpos(&context->audio) - context->trackstart);
+  pos += nframe;
+  if (pos < 0)
+    pos = 0;
+  if (context->nframe && (size_t)pos > context->nframe)
+    pos = context->nframe;
+  context->seekto = pos;
+  context->seekpending = true;
+}
+
+static void scrub_to(GLFWwindow *window, struct context *context, double x) {
+  int width, height;
+  glfwGetWindowSize(window, &width, &height);
+  if (!context->nframe || width <= 0)
+    return;
+  double fraction = x < 0 ? 0.0 : x > width ? 1.0 : x / width;
+  context->seekto = fraction * context->nframe;
+  context->seekpending = true;
+}
+
+static void key_callback(GLFWwindow *window, int key, int scancode, int action, int mods) {
+  (void)scancode;
+  (void)mods;
+  struct context *context = glfwGetWindowUserPointer(window);
+  if (!context || action == GLFW_RELEASE)
+    return;
+
+  /* held arrow keys repeat */
+  long long step = (long long)SEEK_STEP_SECONDS * context->stream->rate;
+  if (key == GLFW_KEY_LEFT || key == GLFW_KEY_RIGHT) {
+    seek_by(context, key == GLFW_KEY_LEFT ? -step : step);
+    return;
+  }
+  if (action != GLFW_PRESS)
+    return;
+
+  if (key == GLFW_KEY_HOME) {
+    context->seekto = 0;
+    context->seekpending = true;
+  } else if (key == GLFW_KEY_Z) {
+    context->view = context->view == VIEW_ZOOM ? VIEW_SPECTRUM : VIEW_ZOOM;
+  } else if (key == GLFW_KEY_M) {
+    context->view = context->view == VIEW_MULTIRES ? VIEW_SPECTRUM : VIEW_MULTIRES;
+  }
+}
+
+static void mouse_button_callback(GLFWwindow *window, int button, int action, int mods) {
+  (void)mods;
+  struct context *context = glfwGetWindowUserPointer(window);
+  if (!context || button != GLFW_MOUSE_BUTTON_LEFT)
+    return;
+  context->scrubbing = action == GLFW_PRESS;
+  if (context->scrubbing) {
+    double x, y;
+    glfwGetCursorPos(window, &x, &y);
+    scrub_to(window, context, x);
+  }
+}
+
+static void cursor_pos_callback(GLFWwindow *window, double x, double y) {
+  (void)y;
+  struct context *context = glfwGetWindowUserPointer(window);
+  if (context && context->scrubbing)
+    scrub_to(window, context, x);
+}
+
+static void update_title(GLFWwindow *window, struct context *context) {
+  char title[256];
+  int len = snprintf(title, sizeof (title), "%s", WINDOW_TITLE);
+  if (context->playlist.npath > 1)
+    len += snprintf(title + len, sizeof (title) - len, " | track %zu/%zu", context->track + 1, context->playlist.npath);
+  size_t seconds = (audio_getpos(&context->audio) - context->trackstart) / context->audio.rate;
+  size_t total = context->nframe / context->audio.rate;
+  len += snprintf(title + len, sizeof (title) - len, " | %zu:%02zu / %zu:%02zu",
+                  seconds / 60, seconds % 60, total / 60, total % 60);
+  if (context->audio.nseek)
+    len += snprintf(title + len, sizeof (title) - len, " | seek %.1f ms", context->audio.seek_latency * 1000);
+  size_t nxrun = atomic_load(&context->audio.nxrun);
+  if (nxrun)
+    len += snprintf(title + len, sizeof (title) - len, " | %zu underruns", nxrun);
+  if (context->tempo > 0.0f && len < (int)sizeof (title))
+    len += snprintf(title + len, sizeof (title) - len, " | %.0f BPM", context->tempo);
+  if (context->humhz && len < (int)sizeof (title))
+    len += snprintf(title + len, sizeof (title) - len, " | hum %u Hz %.0f dB", context->humhz, context->humlevel);
+  for (int i = 0; i < context->audio.nchannel && len < (int)sizeof (title); ++i) {
+    if (context->pitches[i] > 0.0f)
+      len += snprintf(title + len, sizeof (title) - len, " | %.1f Hz", context->pitches[i]);
+    else
+      len += snprintf(title + len, sizeof (title) - len, " | -");
+  }
+  glfwSetWindowTitle(window, title);
+}
+
+static int print_tempo(int nfile, char **files) {
+  for (int i = 0; i < nfile; ++i) {
+    mp3dec_file_info_t info;
+    /* a file without a single frame loads fine, with nothing in it */
+    if (decode_load(files[i], &info, 0) || info.channels == 0 || info.samples == 0) {
+      fprintf(stderr, "failed to load file: %s\n", files[i]);
+      free(info.buffer);
+      continue;
+    }
+    struct onset_analysis analysis;
+    onset_analyze(&analysis, info.buffer, info.samples / info.channels, info.channels, info.hz);
+    printf("%s: %.1f BPM\n", files[i], analysis.bpm);
+    onset_analysis_free(&analysis);
+    free(info.buffer);
+  }
+  return EXIT_SUCCESS;
+}
+
+static int print_psd(int nfile, char **files) {
+  for (int i = 0; i < nfile; ++i) {
+    mp3dec_file_info_t info;
+    if (decode_load(files[i], &info, 0) || info.channels == 0 || info.samples == 0) {
+      fprintf(stderr, "failed to load file: %s\n", files[i]);
+      free(info.buffer);
+      continue;
+    }
+    struct psd_welch psd;
+    psd_init(&psd, info.hz, PSD_LOGSIZE, PSD_HOP);
+    psd_analyze(&psd, info.buffer, info.samples / info.channels, info.channels);
+
+    size_t nbin = ((size_t)1 << PSD_LOGSIZE) / 2 + 1;
+    float *density = malloc(sizeof (density[0]) * nbin);
+    if (!density) {
+      fprintf(stderr, "failed to allocate memory\n");
+      exit(EXIT_FAILURE);
+    }
+    psd_density(&psd, density);
+    printf("# %s: %zu frames, Hz dBFS/Hz\n", files[i], psd.nframe);
+    for (size_t k = 0; k < nbin; ++k)
+      printf("%.1f %.2f\n", (double)k * info.hz / ((size_t)1 << PSD_LOGSIZE), density[k]);
+
+    free(density);
+    psd_deinit(&psd);
+    free(info.buffer);
+  }
+  return EXIT_SUCCESS;
+}
+
+static int build_spectrograms(int nfile, char **files) {
+  const float divisor = 0.7f * DECODE_SAMPLE_SCALE;
+  for (int i = 0; i < nfile; ++i) {
+    uint64_t key;
+    mp3dec_file_info_t info;
+    /* hash only what decodes, the key reads the whole file again */
+    if (decode_load(files[i], &info, 0) || info.channels == 0 || info.samples == 0 || !cache_key(files[i], &key)) {
+      fprintf(stderr, "failed to load file: %s\n", files[i]);
+      free(info.buffer);
+      continue;
+    }
+    if (!spectrogram_build(key, info.buffer, info.samples / info.channels, info.channels, info.hz,
+                           FFT_LOGSIZE, divisor, SPECTROGRAM_BITS)) {
+      fprintf(stderr, "failed to write spectrogram: %s\n", files[i]);
+    } else {
+      printf("%s: %zu frames\n", files[i], (size_t)info.samples / info.channels);
+    }
+    free(info.buffer);
+  }
+  return EXIT_SUCCESS;
+}
+
+static int print_scan(int nfile, char **files) {
+  if (nfile <= 0)
+    return EXIT_SUCCESS;
+  struct scan_info *infos = malloc(sizeof (infos[0]) * nfile);
+  int *errors = malloc(sizeof (errors[0]) * nfile);
+  if (!infos || !errors) {
+    fprintf(stderr, "failed to allocate memory\n");
+    exit(EXIT_FAILURE);
+  }
+  scan_files(files, nfile, infos, errors, 0);
+  for (int i = 0; i < nfile; ++i) {
+    if (errors[i]) {
+      fprintf(stderr, "failed to scan file: %s\n", files[i]);
+      continue;
+    }
+    double seconds = (double)infos[i].nframe / infos[i].hz;
+    printf("%s: %d:%06.3f, %llu frames, %d Hz, %d channels, layer %d, %d kbps\n", files[i],
+           (int)(seconds / 60), seconds - 60 * (int)(seconds / 60), (unsigned long long)infos[i].nframe,
+           infos[i].hz, infos[i].channels, infos[i].layer, infos[i].avg_bitrate_kbps);
+  }
+  free(infos);
+  free(errors);
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,162 @@
+#include "multires.h"
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define MULTIRES_MASK   (MULTIRES_SIZE - 1)
+
+static float halfband[MULTIRES_NTAP];
+
+static void *multires_alloc(size_t size) {
+  void *ptr = malloc(size);
+  if (!ptr) {
+    fprintf(stderr, "failed to allocate memory\n");
+    exit(EXIT_FAILURE);
+  }
+  return ptr;
+}
+
+/* blackman windowed sinc with cutoff at a quarter of the sample rate, unity gain at DC */
+static void multires_design_halfband(void) {
+  const int center = MULTIRES_NTAP / 2;
+  float sum = 0.0f;
+  for (int i = 0; i < MULTIRES_NTAP; ++i) {
+    int n = i - center;
+    double sinc = n == 0 ? 0.5 : sin(M_PI * n / 2) / (M_PI * n);
+    double w = 0.42 - 0.5 * cos(2 * M_PI * i / (MULTIRES_NTAP - 1)) + 0.08 * cos(4 * M_PI * i / (MULTIRES_NTAP - 1));
+    halfband[i] = sinc * w;
+    sum += halfband[i];
+  }
+  for (int i = 0; i < MULTIRES_NTAP; ++i)
+    halfband[i] /= sum;
+}
+
+void multires_init(struct multires *mr, unsigned int rate, const size_t *windows, const float *edges, size_t nband) {
+  if (nband == 0 || nband > MULTIRES_MAXBAND) {
+    fprintf(stderr, "multires: unsupported number of bands: %zu\n", nband);
+    exit(EXIT_FAILURE);
+  }
+  multires_design_halfband();
+
+  mr->rate = rate;
+  mr->nband = nband;
+  mr->nlevel = 1;
+  for (size_t i = 0; i < nband; ++i) {
+    struct multires_band *band = &mr->bands[i];
+    size_t level = 0;
+    while ((MULTIRES_SIZE << level) < windows[i])
+      ++level;
+    if ((MULTIRES_SIZE << level) != windows[i] || level >= MULTIRES_MAXLEVEL) {
+      fprintf(stderr, "multires: unsupported window size: %zu\n", windows[i]);
+      exit(EXIT_FAILURE);
+    }
+    band->level = level;
+    band->fmin = i == 0 ? 0.0f : edges[i - 1];
+    band->fmax = i == nband - 1 ? rate / 2.0f : edges[i];
+    if (level > 0 && band->fmax > rate / 2.0f / ((size_t)1 << level) * 0.9f)
+      fprintf(stderr, "multires: band below %.0f Hz is aliased by decimation\n", band->fmax);
+    band->magnitude = multires_alloc(sizeof (band->magnitude[0]) * (MULTIRES_SIZE / 2 + 1));
+    memset(band->magnitude, 0, sizeof (band->magnitude[0]) * (MULTIRES_SIZE / 2 + 1));
+    if (level + 1 > mr->nlevel)
+      mr->nlevel = level + 1;
+  }
+
+  for (size_t level = 0; level < mr->nlevel; ++level) {
+    mr->history[level] = multires_alloc(sizeof (mr->history[level][0]) * MULTIRES_SIZE);
+    memset(mr->history[level], 0, sizeof (mr->history[level][0]) * MULTIRES_SIZE);
+    mr->count[level] = 0;
+  }
+
+  mr->window = multires_alloc(sizeof (mr->window[0]) * MULTIRES_SIZE);
+  mr->frame = multires_alloc(sizeof (mr->frame[0]) * MULTIRES_SIZE);
+  mr->spectrum = multires_alloc(sizeof (mr->spectrum[0]) * (MULTIRES_SIZE / 2 + 1));
+  for (size_t i = 0; i < MULTIRES_SIZE; ++i)
+    mr->window[i] = 0.5f - 0.5f * cosf(2 * M_PI * i / MULTIRES_SIZE);
+}
+
+void multires_deinit(struct multires *mr) {
+  for (size_t i = 0; i < mr->nband; ++i)
+    free(mr->bands[i].magnitude);
+  for (size_t level = 0; level < mr->nlevel; ++level)
+    free(mr->history[level]);
+  free(mr->window);
+  free(mr->frame);
+  free(mr->spectrum);
+}
+
+static void multires_push(struct multires *mr, float sample) {
+  for (size_t level = 0; level < mr->nlevel; ++level) {
+    float *history = mr->history[level];
+    history[mr->count[level]++ & MULTIRES_MASK] = sample;
+    /* every second sample goes one level down, through the halfband filter */
+    if ((mr->count[level] & 1) || level + 1 == mr->nlevel)
+      return;
+    size_t newest = mr->count[level] - 1;
+    float sum = halfband[MULTIRES_NTAP / 2] * history[(newest - MULTIRES_NTAP / 2) & MULTIRES_MASK];
+    /* odd taps of a halfband filter are zero */
+    for (size_t i = 0; i < MULTIRES_NTAP; i += 2)
+      sum += halfband[i] * history[(newest - i) & MULTIRES_MASK];
+    sample = sum;
+  }
+}
+
+void multires_feed(struct multires *mr, const mp3d_sample_t *data, size_t nframe, size_t nchannel, size_t channel) {
+  for (size_t i = 0; i < nframe; ++i)
+    multires_push(mr, data[i * nchannel + channel]);
+}
+
+void multires_analyze(struct multires *mr) {
+  for (size_t i = 0; i < mr->nband; ++i) {
+    struct multires_band *band = &mr->bands[i];
+    /* bands sharing a level share the transform too */
+    if (i > 0 && mr->bands[i - 1].level == band->level) {
+      memcpy(band->magnitude, mr->bands[i - 1].magnitude, sizeof (band->magnitude[0]) * (MULTIRES_SIZE / 2 + 1));
+      continue;
+    }
+    const float *history = mr->history[band->level];
+    size_t begin = mr->count[band->level];
+    for (size_t j = 0; j < MULTIRES_SIZE; ++j)
+      mr->frame[j] = history[(begin + j) & MULTIRES_MASK] * mr->window[j];
+    fft_real(mr->frame, mr->spectrum, MULTIRES_LOGSIZE);
+    /* the hann window has a coherent gain of 1 / 2 */
+    for (size_t k = 0; k <= MULTIRES_SIZE / 2; ++k) {
+      fft_complex_t bin = mr->spectrum[k];
+      band->magnitude[k] = sqrtf(bin.real * bin.real + bin.imag * bin.imag) * 4 / MULTIRES_SIZE;
+    }
+  }
+}
+
+void multires_resample(const struct multires *mr, float *out, size_t nout, float fmax) {
+  size_t b = 0;
+  for (size_t j = 0; j < nout; ++j) {
+    float lo = fmax * j / nout;
+    float hi = fmax * (j + 1) / nout;
+    while (b + 1 < mr->nband && lo >= mr->bands[b].fmax)
+      ++b;
+    const struct multires_band *band = &mr->bands[b];
+    float binwidth = (float)mr->rate / ((size_t)1 << band->level) / MULTIRES_SIZE;
+
+    /* several band bins in this output bin: keep the peak, otherwise interpolate */
+    float pos = lo / binwidth;
+    size_t first = (size_t)ceilf(pos);
+    size_t last = (size_t)(hi / binwidth);
+    if (last > MULTIRES_SIZE / 2)
+      last = MULTIRES_SIZE / 2;
+    if (last > first) {
+      float peak = 0.0f;
+      for (size_t k = first; k <= last; ++k)
+        peak = band->magnitude[k] > peak ? band->magnitude[k] : peak;
+      out[j] = peak;
+    } else {
+      size_t k = (size_t)pos;
+      if (k >= MULTIRES_SIZE / 2) {
+        out[j] = band->magnitude[MULTIRES_SIZE / 2];
+        continue;
+      }
+      float frac = pos - k;
+      out[j] = band->magnitude[k] * (1.0f - frac) + band->magnitude[k + 1] * frac;
+    }
+  }
+}
@@ -0,0 +1,227 @@
+#include "onset.h"
+#include "decode.h"
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* log(1 + ONSET_COMPRESSION * |X|) keeps quiet partials from being drowned by loud ones */
+#define ONSET_COMPRESSION   100.0f
+/* a peak must exceed ONSET_THRESHOLD * mean + ONSET_DELTA to count as an onset */
+#define ONSET_THRESHOLD     1.5f
+#define ONSET_DELTA         0.01f
+/* smoothing factor of the running mean */
+#define ONSET_MEAN_ALPHA    0.05f
+
+static void *onset_alloc(size_t size) {
+  void *ptr = malloc(size);
+  if (!ptr) {
+    fprintf(stderr, "failed to allocate memory\n");
+    exit(EXIT_FAILURE);
+  }
+  return ptr;
+}
+
+void onset_init(struct onset_detector *det, unsigned int rate, size_t logsize, size_t hop) {
+  size_t size = (size_t)1 << logsize;
+  size_t nfreq = size / 2 + 1;
+
+  det->logsize = logsize;
+  det->hop = hop;
+  det->rate = rate;
+  det->window = onset_alloc(sizeof (det->window[0]) * size);
+  det->frame = onset_alloc(sizeof (det->frame[0]) * size);
+  det->magnitude = onset_alloc(sizeof (det->magnitude[0]) * nfreq);
+  det->fftbuffer = onset_alloc(sizeof (det->fftbuffer[0]) * size);
+  det->envelope = onset_alloc(sizeof (det->envelope[0]) * ONSET_HISTORY);
+  det->nbuffered = 0;
+  det->nframe = 0;
+  det->flux = 0.0f;
+  det->mean = 0.0f;
+  det->onset = false;
+
+  /* hann window */
+  for (size_t i = 0; i < size; ++i)
+    det->window[i] = 0.5f - 0.5f * cosf(2 * M_PI * i / size);
+  memset(det->magnitude, 0, sizeof (det->magnitude[0]) * nfreq);
+}
+
+void onset_deinit(struct onset_detector *det) {
+  free(det->window);
+  free(det->frame);
+  free(det->magnitude);
+  free(det->fftbuffer);
+  free(det->envelope);
+}
+
+static inline float onset_envelope_at(struct onset_detector *det, size_t back) {
+  return det->envelope[(det->nframe - 1 - back) % ONSET_HISTORY];
+}
+
+/* half-wave rectified spectral flux against the previous frame */
+static bool onset_process_frame(struct onset_detector *det, const float *frame) {
+  size_t size = (size_t)1 << det->logsize;
+  size_t nfreq = size / 2 + 1;
+
+  for (size_t i = 0; i < size; ++i) {
+    det->fftbuffer[i].real = frame[i] * det->window[i];
+    det->fftbuffer[i].imag = 0.0f;
+  }
+  fft_inplace(det->fftbuffer, det->logsize);
+
+  float flux = 0.0f;
+  for (size_t k = 0; k < nfreq; ++k) {
+    fft_complex_t bin = det->fftbuffer[k];
+    float magnitude = logf(1.0f + ONSET_COMPRESSION * sqrtf(bin.real * bin.real + bin.imag * bin.imag));
+    float diff = magnitude - det->magnitude[k];
+    if (diff > 0.0f)
+      flux += diff;
+    det->magnitude[k] = magnitude;
+  }
+  /* the first frame has nothing to compare against */
+  flux = det->nframe == 0 ? 0.0f : flux / nfreq;
+
+  det->envelope[det->nframe % ONSET_HISTORY] = flux;
+  det->nframe++;
+  det->flux = flux;
+
+  /* the previous frame is an onset if it is a local maximum above the adaptive threshold */
+  det->onset = false;
+  if (det->nframe >= 3) {
+    float prev = onset_envelope_at(det, 1);
+    float prevprev = onset_envelope_at(det, 2);
+    det->onset = prev > prevprev && prev >= flux && prev > det->mean * ONSET_THRESHOLD + ONSET_DELTA;
+  }
+  det->mean += (flux - det->mean) * ONSET_MEAN_ALPHA;
+  return det->onset;
+}
+
+size_t onset_feed(struct onset_detector *det, const mp3d_sample_t *data, size_t nframe, size_t nchannel) {
+  size_t size = (size_t)1 << det->logsize;
+  size_t nonset = 0;
+  while (nframe) {
+    if (det->nbuffered == size) {
+      memmove(det->frame, det->frame + det->hop, sizeof (det->frame[0]) * (size - det->hop));
+      det->nbuffered = size - det->hop;
+    }
+    size_t n = size - det->nbuffered > nframe ? nframe : size - det->nbuffered;
+    float *frame = det->frame + det->nbuffered;
+    for (size_t i = 0; i < n; ++i) {
+      float sum = 0.0f;
+      for (size_t channel = 0; channel < nchannel; ++channel)
+        sum += data[i * nchannel + channel];
+      frame[i] = sum / (nchannel * DECODE_SAMPLE_SCALE);
+    }
+    det->nbuffered += n;
+    data += n * nchannel;
+    nframe -= n;
+    if (det->nbuffered == size && onset_process_frame(det, det->frame))
+      ++nonset;
+  }
+  return nonset;
+}
+
+float onset_tempo(struct onset_detector *det) {
+  size_t n = det->nframe > ONSET_HISTORY ? ONSET_HISTORY : det->nframe;
+  if (n < 2)
+    return 0.0f;
+  float *envelope = onset_alloc(sizeof (envelope[0]) * n);
+  for (size_t i = 0; i < n; ++i)
+    envelope[i] = onset_envelope_at(det, n - 1 - i);
+  float bpm = onset_estimate_bpm(envelope, n, (float)det->rate / det->hop, ONSET_MIN_BPM, ONSET_MAX_BPM);
+  free(envelope);
+  return bpm;
+}
+
+void onset_analyze(struct onset_analysis *analysis, const mp3d_sample_t *data, size_t nframe, size_t nchannel, unsigned int rate) {
+  struct onset_detector det;
+  onset_init(&det, rate, ONSET_LOGSIZE, ONSET_HOP);
+  size_t size = (size_t)1 << ONSET_LOGSIZE;
+
+  analysis->nframe = nframe < size ? 0 : (nframe - size) / ONSET_HOP + 1;
+  analysis->envelope = onset_alloc(sizeof (analysis->envelope[0]) * (analysis->nframe ? analysis->nframe : 1));
+  analysis->frame_rate = (float)rate / ONSET_HOP;
+
+  /* frames are taken straight from the buffer, no need to go through the sliding window */
+  for (size_t i = 0; i < analysis->nframe; ++i) {
+    const mp3d_sample_t *begin = data + i * ONSET_HOP * nchannel;
+    for (size_t j = 0; j < size; ++j) {
+      float sum = 0.0f;
+      for (size_t channel = 0; channel < nchannel; ++channel)
+        sum += begin[j * nchannel + channel];
+      det.frame[j] = sum / (nchannel * DECODE_SAMPLE_SCALE);
+    }
+    onset_process_frame(&det, det.frame);
+    analysis->envelope[i] = det.flux;
+  }
+  onset_deinit(&det);
+
+  analysis->bpm = onset_estimate_bpm(analysis->envelope, analysis->nframe, analysis->frame_rate,
+                                     ONSET_MIN_BPM, ONSET_MAX_BPM);
+}
+
+void onset_analysis_free(struct onset_analysis *analysis) {
+  free(analysis->envelope);
+}
+
+float onset_estimate_bpm(const float *envelope, size_t n, float frame_rate, float min_bpm, float max_bpm) {
+  size_t minlag = (size_t)floorf(60.0f * frame_rate / max_bpm);
+  size_t maxlag = (size_t)ceilf(60.0f * frame_rate / min_bpm);
+  if (minlag < 1)
+    minlag = 1;
+  if (maxlag + 1 >= n || minlag >= maxlag)
+    return 0.0f;
+
+  /* zero pad to at least 2n so the circular correlation does not wrap */
+  size_t logsize = 0;
+  while (((size_t)1 << logsize) < 2 * n)
+    ++logsize;
+  size_t size = (size_t)1 << logsize;
+
+  float mean = 0.0f;
+  for (size_t i = 0; i < n; ++i)
+    mean += envelope[i];
+  mean /= n;
+
+  /* Wiener-Khinchin: autocorrelation = IFFT(|FFT(x)|^2) */
+  fft_complex_t *buffer = onset_alloc(sizeof (buffer[0]) * size);
+  for (size_t i = 0; i < size; ++i) {
+    buffer[i].real = i < n ? envelope[i] - mean : 0.0f;
+    buffer[i].imag = 0.0f;
+  }
+  fft_inplace(buffer, logsize);
+  for (size_t i = 0; i < size; ++i) {
+    buffer[i].real = buffer[i].real * buffer[i].real + buffer[i].imag * buffer[i].imag;
+    buffer[i].imag = 0.0f;
+  }
+  fft_inverse_inplace(buffer, logsize);
+
+  /* unbiased estimate, so that long lags are not penalized */
+  size_t best = 0;
+  float bestval = 0.0f;
+  for (size_t lag = minlag; lag <= maxlag; ++lag) {
+    float val = buffer[lag].real / (n - lag);
+    if (val > bestval) {
+      bestval = val;
+      best = lag;
+    }
+  }
+  if (best == 0) {
+    free(buffer);
+    return 0.0f;
+  }
+
+  /* parabolic interpolation around the peak for sub-frame precision */
+  float lag = best;
+  if (best > minlag && best < maxlag) {
+    float a = buffer[best - 1].real / (n - best + 1);
+    float b = bestval;
+    float c = buffer[best + 1].real / (n - best - 1);
+    float denom = a - 2 * b + c;
+    if (denom < 0.0f)
+      lag += 0.5f * (a - c) / denom;
+  }
+  free(buffer);
+  return 60.0f * frame_rate / lag;
+}
@@ -0,0 +1,123 @@
+#include "pitch.h"
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static void *pitch_alloc(size_t size) {
+  void *ptr = malloc(size);
+  if (!ptr) {
+    fprintf(stderr, "failed to allocate memory\n");
+    exit(EXIT_FAILURE);
+  }
+  return ptr;
+}
+
+void pitch_init(struct pitch_tracker *tracker, unsigned int rate, size_t logsize) {
+  size_t size = (size_t)1 << logsize;
+  tracker->logsize = logsize;
+  tracker->rate = rate;
+  tracker->frame = pitch_alloc(sizeof (tracker->frame[0]) * size);
+  tracker->head = pitch_alloc(sizeof (tracker->head[0]) * size);
+  tracker->spectrum = pitch_alloc(sizeof (tracker->spectrum[0]) * (size / 2 + 1));
+  tracker->headspectrum = pitch_alloc(sizeof (tracker->headspectrum[0]) * (size / 2 + 1));
+  tracker->correlation = pitch_alloc(sizeof (tracker->correlation[0]) * size);
+  tracker->difference = pitch_alloc(sizeof (tracker->difference[0]) * size / 2);
+  /* the second half of 'head' stays zero */
+  memset(tracker->head, 0, sizeof (tracker->head[0]) * size);
+}
+
+void pitch_deinit(struct pitch_tracker *tracker) {
+  free(tracker->frame);
+  free(tracker->head);
+  free(tracker->spectrum);
+  free(tracker->headspectrum);
+  free(tracker->correlation);
+  free(tracker->difference);
+}
+
+/* r(tau) = sum(x[j] * x[j + tau]) for j < N / 2, computed as IFFT(conj(FFT(head)) * FFT(frame)).
+ * tau + j < N, so the circular correlation never wraps for the lags we look at */
+static void pitch_correlate(struct pitch_tracker *tracker) {
+  size_t size = (size_t)1 << tracker->logsize;
+  size_t window = size / 2;
+
+  memcpy(tracker->head, tracker->frame, sizeof (tracker->head[0]) * window);
+  fft_real(tracker->frame, tracker->spectrum, tracker->logsize);
+  fft_real(tracker->head, tracker->headspectrum, tracker->logsize);
+  for (size_t k = 0; k <= window; ++k) {
+    fft_complex_t a = tracker->headspectrum[k];
+    a.imag = -a.imag;
+    FFT_COMPLEX_SELFMUL(tracker->spectrum[k], a);
+  }
+  fft_real_inverse(tracker->spectrum, tracker->correlation, tracker->logsize);
+}
+
+float pitch_detect(struct pitch_tracker *tracker, float *confidence) {
+  size_t size = (size_t)1 << tracker->logsize;
+  size_t window = size / 2;
+  size_t mintau = (size_t)(tracker->rate / PITCH_MAX_HZ);
+  size_t maxtau = (size_t)(tracker->rate / PITCH_MIN_HZ);
+  if (maxtau > window - 2)
+    maxtau = window - 2;
+  if (mintau < 2)
+    mintau = 2;
+  if (confidence)
+    *confidence = 0.0f;
+  if (mintau >= maxtau)
+    return 0.0f;
+
+  pitch_correlate(tracker);
+
+  /* d(tau) = e(0) + e(tau) - 2 * r(tau), where e(tau) is the energy of the window starting at tau */
+  const float *x = tracker->frame;
+  float *diff = tracker->difference;
+  float energy0 = 0.0f;
+  for (size_t j = 0; j < window; ++j)
+    energy0 += x[j] * x[j];
+  if (energy0 <= 0.0f)
+    return 0.0f;
+
+  float energy = energy0;
+  float sum = 0.0f;
+  diff[0] = 1.0f;
+  for (size_t tau = 1; tau <= maxtau + 1; ++tau) {
+    energy += x[tau + window - 1] * x[tau + window - 1] - x[tau - 1] * x[tau - 1];
+    float d = energy0 + energy - 2 * tracker->correlation[tau];
+    if (d < 0.0f)
+      d = 0.0f;
+    sum += d;
+    /* cumulative mean normalization */
+    diff[tau] = sum > 0.0f ? d * tau / sum : 1.0f;
+  }
+
+  /* first dip below the threshold, followed down to its local minimum */
+  size_t best = 0;
+  for (size_t tau = mintau; tau <= maxtau; ++tau) {
+    if (diff[tau] < PITCH_THRESHOLD) {
+      while (tau + 1 <= maxtau && diff[tau + 1] < diff[tau])
+        ++tau;
+      best = tau;
+      break;
+    }
+  }
+  if (best == 0)
+    return 0.0f;
+
+  float period = best;
+  float a = diff[best - 1], b = diff[best], c = diff[best + 1];
+  float denom = a - 2 * b + c;
+  if (denom > 0.0f)
+    period += 0.5f * (a - c) / denom;
+  if (confidence)
+    *confidence = 1.0f - b;
+  return tracker->rate / period;
+}
+
+float pitch_detect_pcm(struct pitch_tracker *tracker, const mp3d_sample_t *data, size_t nchannel, size_t channel, float *confidence) {
+  size_t size = (size_t)1 << tracker->logsize;
+  for (size_t i = 0; i < size; ++i)
+    tracker->frame[i] = data[i * nchannel + channel];
+  return pitch_detect(tracker, confidence);
+}
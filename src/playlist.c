@@ -0,0 +1,121 @@
+#include "playlist.h"
+
+#include <ctype.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define PLAYLIST_LINE_MAX   4096
+
+static void playlist_push(struct playlist *playlist, const char *path, size_t len) {
+  if (playlist->npath == playlist->capacity) {
+    size_t capacity = playlist->capacity ? playlist->capacity * 2 : 16;
+    char **paths = realloc(playlist->paths, sizeof (paths[0]) * capacity);
+    if (!paths) {
+      fprintf(stderr, "failed to allocate memory\n");
+      exit(EXIT_FAILURE);
+    }
+    playlist->paths = paths;
+    playlist->capacity = capacity;
+  }
+  char *copy = malloc(len + 1);
+  if (!copy) {
+    fprintf(stderr, "failed to allocate memory\n");
+    exit(EXIT_FAILURE);
+  }
+  memcpy(copy, path, len);
+  copy[len] = '\0';
+  playlist->paths[playlist->npath++] = copy;
+}
+
+static bool playlist_is_m3u(const char *path) {
+  const char *dot = strrchr(path, '.');
+  if (!dot)
+    return false;
+  char ext[8];
+  size_t len = strlen(dot + 1);
+  if (len >= sizeof (ext))
+    return false;
+  for (size_t i = 0; i < len; ++i)
+    ext[i] = tolower((unsigned char)dot[1 + i]);
+  ext[len] = '\0';
+  return strcmp(ext, "m3u") == 0 || strcmp(ext, "m3u8") == 0;
+}
+
+static bool playlist_is_absolute(const char *path) {
+#ifdef WIN32
+  return path[0] == '\\' || path[0] == '/' || (path[0] && path[1] == ':');
+#else
+  return path[0] == '/';
+#endif
+}
+
+static bool playlist_load_m3u(struct playlist *playlist, const char *path) {
+  FILE *file = fopen(path, "r");
+  if (!file)
+    return false;
+  /* entries are relative to the directory of the playlist */
+  const char *slash = strrchr(path, '/');
+#ifdef WIN32
+  const char *backslash = strrchr(path, '\\');
+  if (backslash > slash)
+    slash = backslash;
+#endif
+  size_t dirlen = slash ? (size_t)(slash - path) + 1 : 0;
+
+  char line[PLAYLIST_LINE_MAX];
+  char entry[2 * PLAYLIST_LINE_MAX];
+  size_t lineno = 0;
+  while (fgets(line, sizeof (line), file)) {
+    ++lineno;
+    /* a line that does not fit comes in pieces, none of which is an entry */
+    if (!strchr(line, '\n') && !feof(file)) {
+      fprintf(stderr, "%s:%zu: line longer than %d bytes, skipped\n", path, lineno, PLAYLIST_LINE_MAX - 2);
+      while (fgets(line, sizeof (line), file) && !strchr(line, '\n'))
+        continue;
+      continue;
+    }
+    char *begin = line;
+    /* a utf-8 byte order mark is common in .m3u8 */
+    if (strncmp(begin, "\xef\xbb\xbf", 3) == 0)
+      begin += 3;
+    size_t len = strlen(begin);
+    while (len > 0 && isspace((unsigned char)begin[len - 1]))
+      begin[--len] = '\0';
+    while (isspace((unsigned char)*begin))
+      ++begin, --len;
+    /* blank lines and #EXTM3U, #EXTINF and the like */
+    if (len == 0 || begin[0] == '#')
+      continue;
+    if (playlist_is_absolute(begin) || dirlen == 0) {
+      playlist_push(playlist, begin, len);
+    } else {
+      int n = snprintf(entry, sizeof (entry), "%.*s%s", (int)dirlen, path, begin);
+      if (n > 0 && (size_t)n < sizeof (entry))
+        playlist_push(playlist, entry, n);
+      else
+        fprintf(stderr, "%s:%zu: path too long, skipped\n", path, lineno);
+    }
+  }
+  fclose(file);
+  return true;
+}
+
+void playlist_init(struct playlist *playlist) {
+  playlist->paths = NULL;
+  playlist->npath = 0;
+  playlist->capacity = 0;
+}
+
+void playlist_free(struct playlist *playlist) {
+  for (size_t i = 0; i < playlist->npath; ++i)
+    free(playlist->paths[i]);
+  free(playlist->paths);
+}
+
+bool playlist_add(struct playlist *playlist, const char *path) {
+  if (playlist_is_m3u(path))
+    return playlist_load_m3u(playlist, path);
+  playlist_push(playlist, path, strlen(path));
+  return true;
+}
@@ -0,0 +1,136 @@
+#include "psd.h"
+#include "decode.h"
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* floor of the density, avoids log10(0) on digital silence */
+#define PSD_MIN_DB    -200.0f
+
+static void *psd_alloc(size_t size) {
+  void *ptr = malloc(size);
+  if (!ptr) {
+    fprintf(stderr, "failed to allocate memory\n");
+    exit(EXIT_FAILURE);
+  }
+  return ptr;
+}
+
+static inline size_t psd_capacity(const struct psd_welch *psd) {
+  /* enough samples for PSD_BATCH overlapped frames */
+  return ((size_t)1 << psd->logsize) + (PSD_BATCH - 1) * psd->hop;
+}
+
+void psd_init(struct psd_welch *psd, unsigned int rate, size_t logsize, size_t hop) {
+  size_t size = (size_t)1 << logsize;
+  psd->logsize = logsize;
+  psd->hop = hop;
+  psd->rate = rate;
+  psd->window = psd_alloc(sizeof (psd->window[0]) * size);
+  psd->pending = psd_alloc(sizeof (psd->pending[0]) * psd_capacity(psd));
+  psd->batch = psd_alloc(sizeof (psd->batch[0]) * size * PSD_BATCH);
+  psd->sum = psd_alloc(sizeof (psd->sum[0]) * (size / 2 + 1));
+
+  psd->window_power = 0.0;
+  for (size_t i = 0; i < size; ++i) {
+    psd->window[i] = 0.5f - 0.5f * cosf(2 * M_PI * i / size);
+    psd->window_power += (double)psd->window[i] * psd->window[i];
+  }
+  psd_reset(psd);
+}
+
+void psd_deinit(struct psd_welch *psd) {
+  free(psd->window);
+  free(psd->pending);
+  free(psd->batch);
+  free(psd->sum);
+}
+
+void psd_reset(struct psd_welch *psd) {
+  size_t size = (size_t)1 << psd->logsize;
+  memset(psd->sum, 0, sizeof (psd->sum[0]) * (size / 2 + 1));
+  psd->npending = 0;
+  psd->nframe = 0;
+}
+
+/* window 'count' frames out of 'pending', transform them together and accumulate */
+static void psd_process(struct psd_welch *psd, size_t count) {
+  size_t size = (size_t)1 << psd->logsize;
+  for (size_t f = 0; f < count; ++f) {
+    const float *frame = psd->pending + f * psd->hop;
+    fft_complex_t *out = psd->batch + f * size;
+    for (size_t i = 0; i < size; ++i) {
+      out[i].real = frame[i] * psd->window[i];
+      out[i].imag = 0.0f;
+    }
+  }
+  fft_batch_inplace(psd->batch, count, psd->logsize);
+  for (size_t f = 0; f < count; ++f) {
+    const fft_complex_t *out = psd->batch + f * size;
+    for (size_t k = 0; k <= size / 2; ++k)
+      psd->sum[k] += (double)out[k].real * out[k].real + (double)out[k].imag * out[k].imag;
+  }
+  psd->nframe += count;
+
+  size_t consumed = count * psd->hop;
+  memmove(psd->pending, psd->pending + consumed, sizeof (psd->pending[0]) * (psd->npending - consumed));
+  psd->npending -= consumed;
+}
+
+void psd_feed(struct psd_welch *psd, const mp3d_sample_t *data, size_t nframe, size_t nchannel) {
+  size_t capacity = psd_capacity(psd);
+  while (nframe) {
+    size_t n = capacity - psd->npending > nframe ? nframe : capacity - psd->npending;
+    float *pending = psd->pending + psd->npending;
+    for (size_t i = 0; i < n; ++i) {
+      float sum = 0.0f;
+      for (size_t channel = 0; channel < nchannel; ++channel)
+        sum += data[i * nchannel + channel];
+      pending[i] = sum / (nchannel * DECODE_SAMPLE_SCALE);
+    }
+    psd->npending += n;
+    data += n * nchannel;
+    nframe -= n;
+    if (psd->npending == capacity)
+      psd_process(psd, PSD_BATCH);
+  }
+}
+
+void psd_flush(struct psd_welch *psd) {
+  size_t size = (size_t)1 << psd->logsize;
+  if (psd->npending >= size)
+    psd_process(psd, (psd->npending - size) / psd->hop + 1);
+}
+
+void psd_merge(struct psd_welch *psd, const struct psd_welch *part) {
+  size_t size = (size_t)1 << psd->logsize;
+  for (size_t k = 0; k <= size / 2; ++k)
+    psd->sum[k] += part->sum[k];
+  psd->nframe += part->nframe;
+}
+
+void psd_density(const struct psd_welch *psd, float *density) {
+  size_t size = (size_t)1 << psd->logsize;
+  if (psd->nframe == 0) {
+    for (size_t k = 0; k <= size / 2; ++k)
+      density[k] = PSD_MIN_DB;
+    return;
+  }
+  /* P[k] = 2 * |X[k]| ^ 2 / (rate * sum(w ^ 2)), DC and nyquist are not folded */
+  double scale = 1.0 / (psd->nframe * psd->rate * psd->window_power);
+  for (size_t k = 0; k <= size / 2; ++k) {
+    double power = psd->sum[k] * scale;
+    if (k != 0 && k != size / 2)
+      power *= 2;
+    density[k] = power > 0.0 ? 10 * log10(power) : PSD_MIN_DB;
+    if (density[k] < PSD_MIN_DB)
+      density[k] = PSD_MIN_DB;
+  }
+}
+
+void psd_analyze(struct psd_welch *psd, const mp3d_sample_t *data, size_t nframe, size_t nchannel) {
+  psd_feed(psd, data, nframe, nchannel);
+  psd_flush(psd);
+}
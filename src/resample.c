@@ -0,0 +1,256 @@
+#include "resample.h"
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if defined (__SSE__) || defined (_M_X64)
+#include <xmmintrin.h>
+#define RESAMPLE_SSE
+#elif defined (__ARM_NEON)
+#include <arm_neon.h>
+#define RESAMPLE_NEON
+#endif
+
+/* kaiser window, about 85 dB down in the stopband with RESAMPLE_TAPS */
+#define RESAMPLE_BETA     8.6
+/* passband edge plus half the transition, as a fraction of the lower nyquist frequency,
+ * so the stopband starts right at it */
+#define RESAMPLE_CUTOFF   0.955
+
+static void *resample_alloc(size_t size) {
+  void *ptr = malloc(size);
+  if (!ptr) {
+    fprintf(stderr, "failed to allocate memory\n");
+    exit(EXIT_FAILURE);
+  }
+  return ptr;
+}
+
+static uint64_t resample_gcd(uint64_t a, uint64_t b) {
+  while (b) {
+    uint64_t r = a % b;
+    a = b;
+    b = r;
+  }
+  return a;
+}
+
+/* modified bessel function of the first kind, order 0 */
+static double resample_bessel_i0(double x) {
+  double sum = 1.0, term = 1.0;
+  for (int k = 1; k < 64 && term > sum * 1e-12; ++k) {
+    term *= (x / (2 * k)) * (x / (2 * k));
+    sum += term;
+  }
+  return sum;
+}
+
+/* the taps for an output frame 'offset' input frames past the first one, normalized to unit gain */
+static void resample_row(float *row, size_t ntaps, double cutoff, double offset) {
+  double half = ntaps / 2;
+  double sum = 0.0;
+  double *taps = resample_alloc(sizeof (taps[0]) * ntaps);
+  for (size_t k = 0; k < ntaps; ++k) {
+    /* the sinc is centered between taps 'half' - 1 and 'half' */
+    double t = (double)k - (half - 1) - offset;
+    double x = t / half;
+    double window = x * x < 1.0 ? resample_bessel_i0(RESAMPLE_BETA * sqrt(1.0 - x * x)) / resample_bessel_i0(RESAMPLE_BETA) : 0.0;
+    double sinc = t == 0.0 ? 1.0 : sin(M_PI * cutoff * t) / (M_PI * cutoff * t);
+    taps[k] = cutoff * sinc * window;
+    sum += taps[k];
+  }
+  for (size_t k = 0; k < ntaps; ++k)
+    row[k] = (float)(taps[k] / sum);
+  free(taps);
+}
+
+/* 'n' is a multiple of 8 */
+static inline float resample_dot(const float *x, const float *h, size_t n) {
+#if defined (RESAMPLE_SSE)
+  __m128 acc0 = _mm_setzero_ps(), acc1 = _mm_setzero_ps();
+  for (size_t i = 0; i < n; i += 8) {
+    acc0 = _mm_add_ps(acc0, _mm_mul_ps(_mm_loadu_ps(x + i), _mm_loadu_ps(h + i)));
+    acc1 = _mm_add_ps(acc1, _mm_mul_ps(_mm_loadu_ps(x + i + 4), _mm_loadu_ps(h + i + 4)));
+  }
+  acc0 = _mm_add_ps(acc0, acc1);
+  acc0 = _mm_add_ps(acc0, _mm_movehl_ps(acc0, acc0));
+  acc0 = _mm_add_ss(acc0, _mm_shuffle_ps(acc0, acc0, 1));
+  return _mm_cvtss_f32(acc0);
+#elif defined (RESAMPLE_NEON)
+  float32x4_t acc0 = vdupq_n_f32(0.0f), acc1 = vdupq_n_f32(0.0f);
+  for (size_t i = 0; i < n; i += 8) {
+    acc0 = vmlaq_f32(acc0, vld1q_f32(x + i), vld1q_f32(h + i));
+    acc1 = vmlaq_f32(acc1, vld1q_f32(x + i + 4), vld1q_f32(h + i + 4));
+  }
+  acc0 = vaddq_f32(acc0, acc1);
+  float32x2_t sum = vadd_f32(vget_low_f32(acc0), vget_high_f32(acc0));
+  return vget_lane_f32(vpadd_f32(sum, sum), 0);
+#else
+  float acc[4] = { 0.0f, 0.0f, 0.0f, 0.0f };
+  for (size_t i = 0; i < n; i += 4) {
+    acc[0] += x[i] * h[i];
+    acc[1] += x[i + 1] * h[i + 1];
+    acc[2] += x[i + 2] * h[i + 2];
+    acc[3] += x[i + 3] * h[i + 3];
+  }
+  return (acc[0] + acc[1]) + (acc[2] + acc[3]);
+#endif
+}
+
+static inline float resample_in(mp3d_sample_t sample) {
+#ifdef MINIMP3_FLOAT_OUTPUT
+  return sample;
+#else
+  return sample * (1.0f / 32768.0f);
+#endif
+}
+
+static inline mp3d_sample_t resample_out(float sample) {
+#ifdef MINIMP3_FLOAT_OUTPUT
+  return sample;
+#else
+  float scaled = sample * 32768.0f;
+  if (scaled >= 32767.0f)
+    return 32767;
+  if (scaled <= -32768.0f)
+    return -32768;
+  return (mp3d_sample_t)lrintf(scaled);
+#endif
+}
+
+void resample_init(struct resampler *resampler, int nchannel, unsigned int inrate, unsigned int outrate) {
+  uint64_t gcd = resample_gcd(inrate, outrate);
+  resampler->nchannel = nchannel;
+  resampler->inrate = inrate;
+  resampler->outrate = outrate;
+  resampler->den = outrate / gcd;
+  resampler->step = (inrate / gcd) / resampler->den;
+  resampler->frac = (inrate / gcd) % resampler->den;
+  resampler->nphase = resampler->den <= RESAMPLE_MAX_PHASES ? resampler->den : RESAMPLE_MAX_PHASES;
+
+  /* downsampling lowers the cutoff below the input's nyquist frequency, the filter gets longer to match */
+  double ratio = outrate < inrate ? (double)outrate / inrate : 1.0;
+  size_t ntaps = (size_t)ceil(RESAMPLE_TAPS / ratio);
+  ntaps = (ntaps + 7) / 8 * 8;
+  resampler->ntaps = ntaps < RESAMPLE_MAX_TAPS ? ntaps : RESAMPLE_MAX_TAPS;
+
+  resampler->table = resample_alloc(sizeof (resampler->table[0]) * (resampler->nphase + 1) * resampler->ntaps);
+  for (size_t p = 0; p <= resampler->nphase; ++p)
+    resample_row(resampler->table + p * resampler->ntaps, resampler->ntaps, RESAMPLE_CUTOFF * ratio, (double)p / resampler->nphase);
+
+  resampler->capacity = RESAMPLE_BLOCK + resampler->ntaps;
+  resampler->history = resample_alloc(sizeof (resampler->history[0]) * resampler->capacity * nchannel);
+  resample_reset(resampler);
+}
+
+void resample_deinit(struct resampler *resampler) {
+  free(resampler->table);
+  free(resampler->history);
+}
+
+void resample_reset(struct resampler *resampler) {
+  /* the first output frame is centered on the first input frame */
+  resampler->filled = resampler->ntaps / 2 - 1;
+  for (int c = 0; c < resampler->nchannel; ++c)
+    memset(resampler->history + c * resampler->capacity, 0, sizeof (resampler->history[0]) * resampler->filled);
+  resampler->pos = 0;
+  resampler->phase = 0;
+  resampler->padding = 0;
+  resampler->padded = 0;
+  resampler->flushed = false;
+}
+
+static void resample_frame(const struct resampler *resampler, mp3d_sample_t *out) {
+  size_t ntaps = resampler->ntaps;
+  const float *history = resampler->history + resampler->pos;
+  if (resampler->nphase == resampler->den) {
+    const float *row = resampler->table + resampler->phase * ntaps;
+    for (int c = 0; c < resampler->nchannel; ++c)
+      out[c] = resample_out(resample_dot(history + c * resampler->capacity, row, ntaps));
+    return;
+  }
+  /* between two of the precomputed positions */
+  uint64_t scaled = resampler->phase * resampler->nphase;
+  const float *row = resampler->table + scaled / resampler->den * ntaps;
+  float weight = (float)(scaled % resampler->den) / resampler->den;
+  for (int c = 0; c < resampler->nchannel; ++c) {
+    float a = resample_dot(history + c * resampler->capacity, row, ntaps);
+    float b = resample_dot(history + c * resampler->capacity, row + ntaps, ntaps);
+    out[c] = resample_out(a + (b - a) * weight);
+  }
+}
+
+/* move the taps of the next output frame to the front and append up to 'nin' frames of 'in', returns the frames taken */
+static size_t resample_fill(struct resampler *resampler, const mp3d_sample_t *in, size_t nin) {
+  size_t drop = resampler->pos < resampler->filled ? resampler->pos : resampler->filled;
+  size_t room = resampler->capacity - (resampler->filled - drop);
+  size_t n = nin < room ? nin : room;
+  size_t zeros = 0;
+  if (n == 0)
+    zeros = resampler->padding < room ? resampler->padding : room;
+  for (int c = 0; c < resampler->nchannel; ++c) {
+    float *history = resampler->history + c * resampler->capacity;
+    memmove(history, history + drop, sizeof (history[0]) * (resampler->filled - drop));
+    float *dest = history + resampler->filled - drop;
+    for (size_t i = 0; i < n; ++i)
+      dest[i] = resample_in(in[i * resampler->nchannel + c]);
+    memset(dest, 0, sizeof (dest[0]) * zeros);
+  }
+  /* input after a flush, a track queued late: its padding stays in, the new end is flushed again */
+  if (n > 0) {
+    resampler->padding = 0;
+    resampler->flushed = false;
+  }
+  resampler->filled += n + zeros - drop;
+  resampler->pos -= drop;
+  resampler->padding -= zeros;
+  resampler->padded += zeros;
+  return n;
+}
+
+size_t resample_process(struct resampler *resampler, const mp3d_sample_t *in, size_t nin, size_t *consumed,
+                        mp3d_sample_t *out, size_t nout) {
+  size_t taken = 0, written = 0;
+  while (true) {
+    while (written < nout && resampler->pos + resampler->ntaps <= resampler->filled) {
+      resample_frame(resampler, out + written * resampler->nchannel);
+      written++;
+      resampler->pos += resampler->step;
+      resampler->phase += resampler->frac;
+      if (resampler->phase >= resampler->den) {
+        resampler->phase -= resampler->den;
+        resampler->pos++;
+      }
+    }
+    if (written == nout)
+      break;
+    size_t padding = resampler->padding;
+    size_t n = resample_fill(resampler, in ? in + taken * resampler->nchannel : NULL, nin - taken);
+    if (n == 0 && padding == resampler->padding)
+      break;
+    taken += n;
+  }
+  *consumed = taken;
+  return written;
+}
+
+void resample_flush(struct resampler *resampler) {
+  if (resampler->flushed)
+    return;
+  /* up to the last input frame at the center of the taps */
+  resampler->padding = resampler->ntaps / 2;
+  resampler->flushed = true;
+}
+
+bool resample_drained(const struct resampler *resampler) {
+  return resampler->flushed && resampler->padding == 0 && resampler->pos + resampler->ntaps > resampler->filled;
+}
+
+double resample_delay(const struct resampler *resampler) {
+  /* the input so far less the leading zeros, against the center of the next output frame */
+  double delay = (double)(resampler->filled - resampler->padded) - (resampler->ntaps / 2 - 1) - resampler->pos -
+                 (double)resampler->phase / resampler->den;
+  return delay > 0.0 ? delay : 0.0;
+}
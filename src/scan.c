@@ -0,0 +1,149 @@
+#include "scan.h"
+#include "decode.h"
+#include "minimp3/minimp3.h"
+#include "minimp3/minimp3_ex.h"
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef WIN32
+#define fseeko _fseeki64
+#define ftello _ftelli64
+#endif
+
+struct scan_walk {
+  uint64_t start;         /* frames before it are the vbr tag or junk mp3dec_ex skips */
+  uint64_t samples;
+  uint64_t bitrate_kbps;  /* sum over the frames */
+  size_t nframe;
+  int channels, hz, layer;
+};
+
+struct scan_job {
+  char **paths;
+  struct scan_info *infos;
+  int *errors;
+  int nfile;
+  atomic_int next;
+};
+
+static size_t scan_read_cb(void *buf, size_t size, void *user_data) {
+  return fread(buf, 1, size, (FILE *)user_data);
+}
+
+static int scan_seek_cb(uint64_t position, void *user_data) {
+  return fseeko((FILE *)user_data, position, SEEK_SET);
+}
+
+/* samples per channel of one frame, the header decides it alone */
+static inline int scan_frame_samples(const mp3dec_frame_info_t *info) {
+  if (info->layer == 1)
+    return 384;
+  /* mpeg 2 and 2.5 layer 3 frames hold a single granule */
+  return info->layer == 3 && info->hz < 32000 ? 576 : 1152;
+}
+
+static int scan_frame(void *user_data, const uint8_t *frame, int frame_size, int free_format_bytes,
+                      size_t buf_size, uint64_t offset, mp3dec_frame_info_t *info) {
+  (void)frame, (void)frame_size, (void)free_format_bytes, (void)buf_size;
+  struct scan_walk *walk = user_data;
+  if (offset < walk->start)
+    return 0;
+  /* mp3dec_load() rejects a stream whose format changes midway */
+  if (walk->nframe && (info->channels != walk->channels || info->hz != walk->hz || info->layer != walk->layer))
+    return MP3D_E_DECODE;
+  walk->channels = info->channels;
+  walk->hz = info->hz;
+  walk->layer = info->layer;
+  walk->samples += scan_frame_samples(info);
+  walk->bitrate_kbps += info->bitrate_kbps;
+  walk->nframe++;
+  return 0;
+}
+
+int scan_file(const char *path, struct scan_info *info) {
+  memset(info, 0, sizeof (*info));
+  FILE *file = fopen(path, "rb");
+  if (!file)
+    return MP3D_E_IOERROR;
+  mp3dec_io_t io = {
+    .read = scan_read_cb,
+    .read_data = file,
+    .seek = scan_seek_cb,
+    .seek_data = file,
+  };
+
+  /* only the first frame is parsed, with the vbr tag if there is one */
+  mp3dec_ex_t ex;
+  int err = mp3dec_ex_open_cb(&ex, &io, MP3D_SEEK_TO_SAMPLE | MP3D_DO_NOT_SCAN);
+  if (err || ex.info.channels == 0) {
+    mp3dec_ex_close(&ex);
+    fclose(file);
+    return err ? err : MP3D_E_DECODE;
+  }
+  info->channels = ex.info.channels;
+  info->hz = ex.info.hz;
+  info->layer = ex.info.layer;
+
+  if (ex.vbr_tag_found) {
+    info->nframe = ex.detected_samples / ex.info.channels;
+    info->tagged = true;
+    long long size = fseeko(file, 0, SEEK_END) ? -1 : (long long)ftello(file);
+    if (size > 0 && info->nframe)
+      info->avg_bitrate_kbps = (double)(size - ex.start_offset) * 8 * info->hz / info->nframe / 1000;
+  } else {
+    /* no tag, count the samples frame by frame without decoding any */
+    struct scan_walk walk = { .start = ex.start_offset };
+    uint8_t *buf = malloc(MINIMP3_IO_SIZE);
+    if (!buf)
+      err = MP3D_E_MEMORY;
+    else if (fseeko(file, 0, SEEK_SET))
+      err = MP3D_E_IOERROR;
+    else
+      err = mp3dec_iterate_cb(&io, buf, MINIMP3_IO_SIZE, scan_frame, &walk);
+    free(buf);
+    info->nframe = walk.samples;
+    if (walk.nframe)
+      info->avg_bitrate_kbps = walk.bitrate_kbps / walk.nframe;
+  }
+  mp3dec_ex_close(&ex);
+  fclose(file);
+  return err;
+}
+
+static void *scan_worker(void *arg) {
+  struct scan_job *job = arg;
+  int i;
+  while ((i = atomic_fetch_add(&job->next, 1)) < job->nfile)
+    job->errors[i] = scan_file(job->paths[i], &job->infos[i]);
+  return NULL;
+}
+
+void scan_files(char **paths, int nfile, struct scan_info *infos, int *errors, int nthread) {
+  struct scan_job job = {
+    .paths = paths,
+    .infos = infos,
+    .errors = errors,
+    .nfile = nfile,
+  };
+  atomic_init(&job.next, 0);
+  if (nthread <= 0)
+    nthread = decode_ncpu();
+  if (nthread > nfile)
+    nthread = nfile;
+
+  /* the calling thread works too */
+  pthread_t *threads = nthread > 1 ? malloc(sizeof (threads[0]) * (nthread - 1)) : NULL;
+  int nstarted = 0;
+  if (threads) {
+    while (nstarted < nthread - 1 && !pthread_create(&threads[nstarted], NULL, scan_worker, &job))
+      ++nstarted;
+  }
+  scan_worker(&job);
+  for (int i = 0; i < nstarted; ++i)
+    pthread_join(threads[i], NULL);
+  free(threads);
+}
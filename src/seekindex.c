@@ -0,0 +1,188 @@
+#include "seekindex.h"
+#include "cache.h"
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+
+#ifdef WIN32
+#define fseeko _fseeki64
+#endif
+
+#define SEEKINDEX_MAGIC   "FFTIDX"
+/* a varint of a 64 bit value takes at most 10 bytes */
+#define SEEKINDEX_VARINT_MAX  10
+
+struct seekindex_header {
+  char magic[8];
+  uint32_t version;
+  uint32_t reserved;
+  uint64_t file_size;
+  int64_t file_mtime;
+  uint64_t start_offset;
+  uint64_t detected_samples;
+  uint64_t nframe;
+  uint64_t nbyte;         /* varints following the header */
+};
+
+static size_t seekindex_read_cb(void *buf, size_t size, void *user_data) {
+  return fread(buf, 1, size, (FILE *)user_data);
+}
+
+static int seekindex_seek_cb(uint64_t position, void *user_data) {
+  return fseeko((FILE *)user_data, position, SEEK_SET);
+}
+
+static bool seekindex_path(char *path, size_t size, const char *file) {
+  uint64_t key;
+  char suffix[32];
+  if (!cache_name_key(file, &key))
+    return false;
+  snprintf(suffix, sizeof (suffix), "%d.idx", SEEKINDEX_VERSION);
+  return cache_path(path, size, key, suffix);
+}
+
+static bool seekindex_stat(const char *file, uint64_t *size, int64_t *mtime) {
+  struct stat st;
+  if (stat(file, &st))
+    return false;
+  *size = st.st_size;
+  *mtime = st.st_mtime;
+  return true;
+}
+
+static inline size_t seekindex_put(uint8_t *buf, uint64_t value) {
+  size_t n = 0;
+  while (value >= 0x80) {
+    buf[n++] = (uint8_t)(value | 0x80);
+    value >>= 7;
+  }
+  buf[n++] = (uint8_t)value;
+  return n;
+}
+
+/* returns the bytes consumed, 0 if the varint runs past 'end' or overflows */
+static inline size_t seekindex_get(const uint8_t *buf, const uint8_t *end, uint64_t *value) {
+  uint64_t result = 0;
+  for (size_t n = 0; n < SEEKINDEX_VARINT_MAX && buf + n < end; ++n) {
+    result |= (uint64_t)(buf[n] & 0x7f) << (7 * n);
+    if (!(buf[n] & 0x80)) {
+      *value = result;
+      return n + 1;
+    }
+  }
+  return 0;
+}
+
+bool seekindex_save(const mp3dec_ex_t *dec, const char *path) {
+  const mp3dec_index_t *index = &dec->index;
+  struct seekindex_header header = {
+    .magic = SEEKINDEX_MAGIC,
+    .version = SEEKINDEX_VERSION,
+    .start_offset = dec->start_offset,
+    .detected_samples = dec->detected_samples,
+    .nframe = index->num_frames,
+  };
+  char entry[CACHE_PATH_MAX], tmppath[CACHE_PATH_MAX];
+  if (!dec->indexes_built || !seekindex_stat(path, &header.file_size, &header.file_mtime) ||
+      !seekindex_path(entry, sizeof (entry), path) || !cache_tmppath(tmppath, sizeof (tmppath), entry))
+    return false;
+
+  uint8_t *buf = malloc(index->num_frames * 2 * SEEKINDEX_VARINT_MAX + 1);
+  if (!buf)
+    return false;
+  uint64_t offset = dec->start_offset, sample = 0;
+  for (size_t i = 0; i < index->num_frames; ++i) {
+    /* both only grow, the first offset counts from the first frame */
+    header.nbyte += seekindex_put(buf + header.nbyte, index->frames[i].offset - offset);
+    header.nbyte += seekindex_put(buf + header.nbyte, index->frames[i].sample - sample);
+    offset = index->frames[i].offset;
+    sample = index->frames[i].sample;
+  }
+
+  FILE *file = fopen(tmppath, "wb");
+  bool ok = file && fwrite(&header, sizeof (header), 1, file) == 1 &&
+            fwrite(buf, 1, header.nbyte, file) == header.nbyte;
+  free(buf);
+  if (!file || fclose(file) || !ok) {
+    remove(tmppath);
+    return false;
+  }
+  return cache_commit(tmppath, entry);
+}
+
+bool seekindex_load(mp3dec_ex_t *dec, const char *path) {
+  char entry[CACHE_PATH_MAX];
+  uint64_t file_size;
+  int64_t file_mtime;
+  if (!(dec->flags & MP3D_SEEK_TO_SAMPLE) || dec->indexes_built || !seekindex_stat(path, &file_size, &file_mtime) ||
+      !seekindex_path(entry, sizeof (entry), path))
+    return false;
+  FILE *file = fopen(entry, "rb");
+  if (!file)
+    return false;
+
+  struct seekindex_header header;
+  bool ok = fread(&header, sizeof (header), 1, file) == 1 &&
+            !memcmp(header.magic, SEEKINDEX_MAGIC, sizeof (SEEKINDEX_MAGIC)) &&
+            header.version == SEEKINDEX_VERSION && header.file_size == file_size &&
+            header.file_mtime == file_mtime && header.start_offset == dec->start_offset &&
+            header.detected_samples == dec->detected_samples &&
+            header.nframe <= header.file_size && header.nbyte <= header.nframe * 2 * SEEKINDEX_VARINT_MAX;
+  uint8_t *buf = ok ? malloc(header.nbyte + 1) : NULL;
+  mp3dec_frame_t *frames = ok ? malloc(sizeof (frames[0]) * (header.nframe + 1)) : NULL;
+  ok = buf && frames && fread(buf, 1, header.nbyte, file) == header.nbyte;
+  fclose(file);
+
+  const uint8_t *pos = buf, *end = ok ? buf + header.nbyte : buf;
+  uint64_t offset = header.start_offset, sample = 0;
+  for (size_t i = 0; ok && i < header.nframe; ++i) {
+    uint64_t doffset, dsample;
+    size_t n = seekindex_get(pos, end, &doffset);
+    size_t m = n ? seekindex_get(pos + n, end, &dsample) : 0;
+    if (!m) {
+      ok = false;
+      break;
+    }
+    pos += n + m;
+    offset += doffset;
+    sample += dsample;
+    frames[i].offset = offset;
+    frames[i].sample = sample;
+  }
+  free(buf);
+  /* a truncated or damaged entry is as good as none */
+  if (!ok || pos != end || (header.nframe && frames[header.nframe - 1].offset >= file_size)) {
+    free(frames);
+    return false;
+  }
+
+  /* the state mp3dec_ex_seek() leaves behind after its own scan */
+  dec->index.frames = frames;
+  dec->index.num_frames = header.nframe;
+  dec->index.capacity = header.nframe + 1;
+  dec->indexes_built = 1;
+  dec->samples = dec->detected_samples;
+  return true;
+}
+
+bool seekindex_build(const char *path) {
+  FILE *file = fopen(path, "rb");
+  if (!file)
+    return false;
+  mp3dec_io_t io = {
+    .read = seekindex_read_cb,
+    .read_data = file,
+    .seek = seekindex_seek_cb,
+    .seek_data = file,
+  };
+  mp3dec_ex_t ex;
+  /* the first seek away from zero makes mp3dec_ex scan the whole file */
+  bool ok = !mp3dec_ex_open_cb(&ex, &io, MP3D_SEEK_TO_SAMPLE | MP3D_DO_NOT_SCAN) && ex.info.channels &&
+            !mp3dec_ex_seek(&ex, 1) && seekindex_save(&ex, path);
+  mp3dec_ex_close(&ex);
+  fclose(file);
+  return ok;
+}
@@ -0,0 +1,133 @@
+#include "sink.h"
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef WIN32
+#define fseeko _fseeki64
+#endif
+
+#define SINK_WAVE_PCM       0x0001
+#define SINK_WAVE_FLOAT     0x0003
+/* RIFF, fmt and data chunk headers */
+#define SINK_WAVE_HEADER    44
+
+static inline void sink_le16(uint8_t *p, uint16_t value) {
+  p[0] = (uint8_t)value;
+  p[1] = (uint8_t)(value >> 8);
+}
+
+static inline void sink_le32(uint8_t *p, uint32_t value) {
+  sink_le16(p, (uint16_t)value);
+  sink_le16(p + 2, (uint16_t)(value >> 16));
+}
+
+/* the sizes are filled in once the length is known, see sink_close() */
+static bool sink_wave_header(FILE *file, int nchannel, unsigned int rate, uint64_t nframe) {
+  uint8_t header[SINK_WAVE_HEADER];
+  size_t align = sizeof (mp3d_sample_t) * nchannel;
+  uint64_t size = nframe * align;
+  /* a riff size is 32 bits, a longer file says as much as fits */
+  if (size > UINT32_MAX - SINK_WAVE_HEADER)
+    size = (UINT32_MAX - SINK_WAVE_HEADER) / align * align;
+  memcpy(header, "RIFF", 4);
+  sink_le32(header + 4, (uint32_t)(SINK_WAVE_HEADER - 8 + size));
+  memcpy(header + 8, "WAVEfmt ", 8);
+  sink_le32(header + 16, 16);
+#ifdef MINIMP3_FLOAT_OUTPUT
+  sink_le16(header + 20, SINK_WAVE_FLOAT);
+#else
+  sink_le16(header + 20, SINK_WAVE_PCM);
+#endif
+  sink_le16(header + 22, (uint16_t)nchannel);
+  sink_le32(header + 24, rate);
+  sink_le32(header + 28, (uint32_t)(rate * align));
+  sink_le16(header + 32, (uint16_t)align);
+  sink_le16(header + 34, (uint16_t)(sizeof (mp3d_sample_t) * 8));
+  memcpy(header + 36, "data", 4);
+  sink_le32(header + 40, (uint32_t)size);
+  return fwrite(header, sizeof (header), 1, file) == 1;
+}
+
+/* the frame the clock has reached, at most what was written */
+static size_t sink_played(const struct sink *sink, double now) {
+  if (sink->fast)
+    return sink->written;
+  size_t pos = sink->clockpos + (now > sink->clocktime ? (size_t)((now - sink->clocktime) * sink->rate) : 0);
+  return pos < sink->written ? pos : sink->written;
+}
+
+enum sink_kind sink_kind(const char *params) {
+  if (!params)
+    return SINK_NONE;
+  if (strcmp(params, SINK_NULL_NAME) == 0 || strcmp(params, SINK_NULL_FAST_NAME) == 0)
+    return SINK_NULL;
+  if (strncmp(params, SINK_WAV_PREFIX, strlen(SINK_WAV_PREFIX)) == 0)
+    return SINK_WAV;
+  return SINK_NONE;
+}
+
+bool sink_open(struct sink *sink, const char *params, int nchannel, unsigned int rate, size_t buffer, double now) {
+  memset(sink, 0, sizeof (*sink));
+  sink->kind = sink_kind(params);
+  sink->fast = sink->kind == SINK_WAV || strcmp(params, SINK_NULL_FAST_NAME) == 0;
+  sink->nchannel = nchannel;
+  sink->rate = rate;
+  sink->buffer = buffer;
+  sink->clocktime = now;
+  sink->opentime = now;
+  if (sink->kind != SINK_WAV)
+    return true;
+  sink->file = fopen(params + strlen(SINK_WAV_PREFIX), "wb");
+  if (!sink->file)
+    return false;
+  if (!sink_wave_header(sink->file, nchannel, rate, 0)) {
+    fclose(sink->file);
+    return false;
+  }
+  return true;
+}
+
+void sink_close(struct sink *sink, double now) {
+  if (sink->file) {
+    if (fseeko(sink->file, 0, SEEK_SET) || !sink_wave_header(sink->file, sink->nchannel, sink->rate, sink->written))
+      fprintf(stderr, "failed to finish the wav file\n");
+    fclose(sink->file);
+  }
+  size_t played = sink_played(sink, now);
+  double elapsed = now - sink->opentime;
+  double seconds = (double)played / sink->rate;
+  fprintf(stderr, "sink: %zu frames in %.3f s, %.1fx real time\n", played, elapsed,
+          elapsed > 0.0 ? seconds / elapsed : 0.0);
+}
+
+size_t sink_delay(const struct sink *sink, double now) {
+  return sink->written - sink_played(sink, now);
+}
+
+size_t sink_room(const struct sink *sink, double now) {
+  if (sink->fast)
+    return SIZE_MAX;
+  size_t delay = sink_delay(sink, now);
+  return delay < sink->buffer ? sink->buffer - delay : 0;
+}
+
+bool sink_write(struct sink *sink, const mp3d_sample_t *data, size_t nframe, double now) {
+  /* the clock stands while nothing is queued and goes on with the first frame after */
+  if (sink_played(sink, now) == sink->written) {
+    sink->clockpos = sink->written;
+    sink->clocktime = now;
+  }
+  if (sink->file && fwrite(data, sizeof (data[0]) * sink->nchannel, nframe, sink->file) != nframe)
+    return false;
+  sink->written += nframe;
+  return true;
+}
+
+void sink_drop(struct sink *sink, double now) {
+  /* the wav file keeps what it was given */
+  sink->written = sink_played(sink, now);
+  sink->clockpos = sink->written;
+  sink->clocktime = now;
+}
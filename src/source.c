@@ -0,0 +1,443 @@
+#include "source.h"
+#include "decode.h"
+#include "seekindex.h"
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef WIN32
+#include <fcntl.h>
+#include <io.h>
+#define fseeko _fseeki64
+#endif
+
+#define SOURCE_WAVE_PCM         0x0001
+#define SOURCE_WAVE_FLOAT       0x0003
+#define SOURCE_WAVE_EXTENSIBLE  0xfffe
+/* the data size a wav written to a pipe carries when the length is not known yet */
+#define SOURCE_WAVE_UNKNOWN     0xffffffffu
+
+/* pcm in this format is the sample type itself and needs no conversion */
+#ifdef MINIMP3_FLOAT_OUTPUT
+#define SOURCE_NATIVE_FORMAT    SOURCE_F32
+#else
+#define SOURCE_NATIVE_FORMAT    SOURCE_S16
+#endif
+
+static const struct {
+  const char *name;
+  enum source_format format;
+  size_t bytes;
+} source_formats[] = {
+  { "u8", SOURCE_U8, 1 },
+  { "s16", SOURCE_S16, 2 },
+  { "s24", SOURCE_S24, 3 },
+  { "s32", SOURCE_S32, 4 },
+  { "f32", SOURCE_F32, 4 },
+};
+
+static size_t source_file_read(void *buf, size_t size, void *user_data) {
+  return fread(buf, 1, size, (FILE *)user_data);
+}
+
+static int source_file_seek(uint64_t position, void *user_data) {
+  return fseeko((FILE *)user_data, position, SEEK_SET);
+}
+
+static bool source_pipe_keep(struct source_pipe *pipe, const uint8_t *data, size_t size) {
+  if (pipe->nhead + size > pipe->capacity) {
+    size_t capacity = pipe->capacity ? pipe->capacity : MINIMP3_IO_SIZE;
+    while (capacity < pipe->nhead + size)
+      capacity *= 2;
+    if (capacity > SOURCE_PIPE_HEAD_MAX)
+      return false;
+    uint8_t *head = realloc(pipe->head, capacity);
+    if (!head)
+      return false;
+    pipe->head = head;
+    pipe->capacity = capacity;
+  }
+  memcpy(pipe->head + pipe->nhead, data, size);
+  pipe->nhead += size;
+  return true;
+}
+
+/* while 'head' is kept the pipe itself stands right after it */
+static size_t source_pipe_read(void *buf, size_t size, void *user_data) {
+  struct source_pipe *pipe = user_data;
+  uint8_t *out = buf;
+  size_t n = 0;
+  if (pipe->head && pipe->pos < pipe->nhead) {
+    n = pipe->nhead - pipe->pos < size ? pipe->nhead - pipe->pos : size;
+    memcpy(out, pipe->head + pipe->pos, n);
+    pipe->pos += n;
+  }
+  if (n == size)
+    return n;
+
+  if (!pipe->recording) {
+    free(pipe->head);
+    pipe->head = NULL;
+  }
+  size_t m = fread(out + n, 1, size - n, pipe->file);
+  if (pipe->recording && !source_pipe_keep(pipe, out + n, m)) {
+    /* too long a head, seeking back over it fails from now on */
+    pipe->recording = false;
+    free(pipe->head);
+    pipe->head = NULL;
+  }
+  pipe->pos += m;
+  return n + m;
+}
+
+/* back into the head kept so far, or forward by reading */
+static int source_pipe_seek(uint64_t position, void *user_data) {
+  struct source_pipe *pipe = user_data;
+  if (pipe->head && position <= pipe->nhead) {
+    pipe->pos = position;
+    return 0;
+  }
+  if (position < pipe->pos)
+    return -1;
+  uint8_t skip[4096];
+  while (pipe->pos < position) {
+    size_t size = position - pipe->pos > sizeof (skip) ? sizeof (skip) : position - pipe->pos;
+    if (source_pipe_read(skip, size, pipe) != size)
+      return -1;
+  }
+  return 0;
+}
+
+static bool source_take(struct source *source, void *buf, size_t size) {
+  return source->io.read(buf, size, source->io.read_data) == size;
+}
+
+static bool source_skip(struct source *source, uint64_t size) {
+  uint8_t skip[4096];
+  while (size > 0) {
+    size_t n = size > sizeof (skip) ? sizeof (skip) : size;
+    if (!source_take(source, skip, n))
+      return false;
+    size -= n;
+  }
+  return true;
+}
+
+static inline uint16_t source_le16(const uint8_t *p) {
+  return (uint16_t)(p[0] | p[1] << 8);
+}
+
+static inline uint32_t source_le32(const uint8_t *p) {
+  return (uint32_t)p[0] | (uint32_t)p[1] << 8 | (uint32_t)p[2] << 16 | (uint32_t)p[3] << 24;
+}
+
+/* from [-1, 1) to the sample type */
+static inline mp3d_sample_t source_sample(float value) {
+#ifdef MINIMP3_FLOAT_OUTPUT
+  return value;
+#else
+  float scaled = value * DECODE_SAMPLE_SCALE;
+  if (scaled >= 32767.0f)
+    return 32767;
+  if (scaled <= -32768.0f)
+    return -32768;
+  return (mp3d_sample_t)lrintf(scaled);
+#endif
+}
+
+static void source_convert(mp3d_sample_t *dest, const uint8_t *src, size_t nsample, enum source_format format) {
+  if (format == SOURCE_NATIVE_FORMAT) {
+    memcpy(dest, src, sizeof (dest[0]) * nsample);
+    return;
+  }
+  switch (format) {
+    case SOURCE_U8:
+      for (size_t i = 0; i < nsample; ++i)
+        dest[i] = source_sample((src[i] - 128) * (1.0f / 128));
+      break;
+    case SOURCE_S16:
+      for (size_t i = 0; i < nsample; ++i)
+        dest[i] = source_sample((int16_t)source_le16(src + i * 2) * (1.0f / 32768));
+      break;
+    case SOURCE_S24:
+      /* shifted up to 32 bits so the sign comes along */
+      for (size_t i = 0; i < nsample; ++i) {
+        const uint8_t *p = src + i * 3;
+        int32_t value = (int32_t)((uint32_t)p[0] << 8 | (uint32_t)p[1] << 16 | (uint32_t)p[2] << 24);
+        dest[i] = source_sample(value * (1.0f / 2147483648.0f));
+      }
+      break;
+    case SOURCE_S32:
+      for (size_t i = 0; i < nsample; ++i)
+        dest[i] = source_sample((int32_t)source_le32(src + i * 4) * (1.0f / 2147483648.0f));
+      break;
+    case SOURCE_F32:
+      for (size_t i = 0; i < nsample; ++i) {
+        float value;
+        memcpy(&value, src + i * 4, sizeof (value));
+        dest[i] = source_sample(value);
+      }
+      break;
+  }
+}
+
+/* the samples start 'offset' bytes in, 'size' bytes of them or up to the end if 0 */
+static int source_setup_pcm(struct source *source, enum source_format format, int nchannel, unsigned int rate,
+                            uint64_t offset, uint64_t size) {
+  if (nchannel <= 0 || rate == 0)
+    return MP3D_E_PARAM;
+  source->kind = SOURCE_PCM;
+  source->format = format;
+  source->nchannel = nchannel;
+  source->rate = rate;
+  source->frame_bytes = source_formats[format].bytes * nchannel;
+  source->nframe = size / source->frame_bytes;
+  if (!source->path)
+    return 0;
+
+  /* a file is read in place, only the samples it touches are paged in */
+  if (!cache_map_file(&source->mapping, source->path) || offset > source->mapping.size)
+    return MP3D_E_IOERROR;
+  size_t available = (source->mapping.size - offset) / source->frame_bytes;
+  if (source->nframe == 0 || source->nframe > available)
+    source->nframe = available;
+  source->pcm = (const uint8_t *)source->mapping.base + offset;
+  if (format == SOURCE_NATIVE_FORMAT && (uintptr_t)source->pcm % sizeof (mp3d_sample_t) == 0)
+    source->frames = (const mp3d_sample_t *)source->pcm;
+  source->seekable = true;
+  return 0;
+}
+
+static int source_open_wav(struct source *source) {
+  uint8_t riff[12];
+  if (!source_take(source, riff, sizeof (riff)))
+    return MP3D_E_IOERROR;
+  uint64_t offset = sizeof (riff);
+  uint8_t fmt[40];
+  bool hasfmt = false;
+  uint32_t size;
+  while (true) {
+    uint8_t chunk[8];
+    if (!source_take(source, chunk, sizeof (chunk)))
+      return MP3D_E_DECODE;
+    offset += sizeof (chunk);
+    size = source_le32(chunk + 4);
+    if (memcmp(chunk, "data", 4) == 0)
+      break;
+    /* chunks are padded to an even size */
+    uint64_t padded = (uint64_t)size + (size & 1);
+    if (memcmp(chunk, "fmt ", 4) == 0) {
+      size_t n = size < sizeof (fmt) ? size : sizeof (fmt);
+      if (size < 16 || !source_take(source, fmt, n) || !source_skip(source, padded - n))
+        return MP3D_E_DECODE;
+      if (n < sizeof (fmt))
+        memset(fmt + n, 0, sizeof (fmt) - n);
+      hasfmt = true;
+    } else if (!source_skip(source, padded)) {
+      return MP3D_E_DECODE;
+    }
+    offset += padded;
+  }
+  if (!hasfmt)
+    return MP3D_E_DECODE;
+
+  uint16_t tag = source_le16(fmt);
+  int nchannel = source_le16(fmt + 2);
+  unsigned int rate = source_le32(fmt + 4);
+  uint16_t align = source_le16(fmt + 12);
+  uint16_t bits = source_le16(fmt + 14);
+  /* the real tag is the first two bytes of the subformat guid */
+  if (tag == SOURCE_WAVE_EXTENSIBLE)
+    tag = source_le16(fmt + 24);
+  enum source_format format;
+  if (tag == SOURCE_WAVE_FLOAT && bits == 32)
+    format = SOURCE_F32;
+  else if (tag == SOURCE_WAVE_PCM && bits == 8)
+    format = SOURCE_U8;
+  else if (tag == SOURCE_WAVE_PCM && bits == 16)
+    format = SOURCE_S16;
+  else if (tag == SOURCE_WAVE_PCM && bits == 24)
+    format = SOURCE_S24;
+  else if (tag == SOURCE_WAVE_PCM && bits == 32)
+    format = SOURCE_S32;
+  else
+    return MP3D_E_DECODE;
+  if (align != source_formats[format].bytes * nchannel)
+    return MP3D_E_DECODE;
+  return source_setup_pcm(source, format, nchannel, rate, offset, size == SOURCE_WAVE_UNKNOWN ? 0 : size);
+}
+
+static int source_open_mp3(struct source *source) {
+  /* callback io keeps only MINIMP3_IO_SIZE bytes of the file in memory,
+   * and MP3D_DO_NOT_SCAN defers the index scan to the first seek */
+  int err = mp3dec_ex_open_cb(&source->dec, &source->io, MP3D_SEEK_TO_SAMPLE | MP3D_DO_NOT_SCAN);
+  if (err || source->dec.info.channels == 0 || source->dec.info.hz == 0) {
+    mp3dec_ex_close(&source->dec);
+    return err ? err : MP3D_E_DECODE;
+  }
+  source->kind = SOURCE_MP3;
+  source->nchannel = source->dec.info.channels;
+  source->rate = source->dec.info.hz;
+  if (source->dec.vbr_tag_found)
+    source->nframe = source->dec.detected_samples / source->nchannel;
+  if (source->path) {
+    source->indexed = seekindex_load(&source->dec, source->path);
+    source->seekable = true;
+  }
+  return 0;
+}
+
+/* open the file behind 'path', or standard input */
+static int source_attach(struct source *source, const char *path) {
+  if (strcmp(path, SOURCE_STDIN) == 0) {
+#ifdef WIN32
+    _setmode(_fileno(stdin), _O_BINARY);
+#endif
+    source->pipe.file = stdin;
+    source->pipe.recording = true;
+    source->io.read = source_pipe_read;
+    source->io.read_data = &source->pipe;
+    source->io.seek = source_pipe_seek;
+    source->io.seek_data = &source->pipe;
+    return 0;
+  }
+  source->path = strdup(path);
+  if (!source->path)
+    return MP3D_E_MEMORY;
+  source->file = fopen(path, "rb");
+  if (!source->file)
+    return MP3D_E_IOERROR;
+  source->io.read = source_file_read;
+  source->io.read_data = source->file;
+  source->io.seek = source_file_seek;
+  source->io.seek_data = source->file;
+  return 0;
+}
+
+/* "<rate>:<channels>:<format>:<path>" */
+static int source_open_raw(struct source *source, const char *spec) {
+  char *end;
+  unsigned long rate = strtoul(spec, &end, 10);
+  if (*end != ':')
+    return MP3D_E_PARAM;
+  unsigned long nchannel = strtoul(end + 1, &end, 10);
+  if (*end != ':' || nchannel > 64)
+    return MP3D_E_PARAM;
+  const char *name = end + 1;
+  const char *colon = strchr(name, ':');
+  if (!colon)
+    return MP3D_E_PARAM;
+  size_t i = 0;
+  while (i < sizeof (source_formats) / sizeof (source_formats[0]) &&
+         (strlen(source_formats[i].name) != (size_t)(colon - name) ||
+          strncmp(source_formats[i].name, name, colon - name) != 0))
+    ++i;
+  if (i == sizeof (source_formats) / sizeof (source_formats[0]))
+    return MP3D_E_PARAM;
+
+  int err = source_attach(source, colon + 1);
+  if (err)
+    return err;
+  return source_setup_pcm(source, source_formats[i].format, nchannel, rate, 0, 0);
+}
+
+static void source_release(struct source *source) {
+  mp3dec_ex_close(&source->dec);
+  cache_unmap(&source->mapping);
+  if (source->file)
+    fclose(source->file);
+  free(source->pipe.head);
+  free(source->scratch);
+  free(source->path);
+}
+
+int source_open(struct source *source, const char *path) {
+  memset(source, 0, sizeof (*source));
+  int err;
+  if (strncmp(path, SOURCE_RAW_PREFIX, strlen(SOURCE_RAW_PREFIX)) == 0) {
+    err = source_open_raw(source, path + strlen(SOURCE_RAW_PREFIX));
+  } else if (!(err = source_attach(source, path))) {
+    /* a pipe replays what was sniffed, a file seeks back */
+    uint8_t magic[12];
+    bool wav = source_take(source, magic, sizeof (magic)) &&
+               memcmp(magic, "RIFF", 4) == 0 && memcmp(magic + 8, "WAVE", 4) == 0;
+    if (source->io.seek(0, source->io.seek_data))
+      err = MP3D_E_IOERROR;
+    else
+      err = wav ? source_open_wav(source) : source_open_mp3(source);
+  }
+  source->pipe.recording = false;
+  if (err) {
+    source_release(source);
+    return err;
+  }
+  /* a pcm file is mapped, the stdio stream is done with */
+  if (source->pcm) {
+    fclose(source->file);
+    source->file = NULL;
+  }
+  return 0;
+}
+
+void source_close(struct source *source) {
+  source_release(source);
+}
+
+size_t source_read(struct source *source, mp3d_sample_t *dest, size_t nframe) {
+  if (source->kind == SOURCE_MP3) {
+    size_t nsample = mp3dec_ex_read(&source->dec, dest, nframe * source->nchannel);
+    if (nsample < nframe * source->nchannel && source->dec.last_error)
+      source->failed = true;
+    return nsample / source->nchannel;
+  }
+
+  if (source->nframe && nframe > source->nframe - source->pos)
+    nframe = source->nframe - source->pos;
+  const uint8_t *src = source->pcm ? source->pcm + source->pos * source->frame_bytes : NULL;
+  if (!src) {
+    size_t nbyte = nframe * source->frame_bytes;
+    if (nbyte > source->scratch_bytes) {
+      uint8_t *scratch = realloc(source->scratch, nbyte);
+      if (!scratch) {
+        source->failed = true;
+        return 0;
+      }
+      source->scratch = scratch;
+      source->scratch_bytes = nbyte;
+    }
+    size_t nread = source->io.read(source->scratch, nbyte, source->io.read_data);
+    if (nread < nbyte && ferror(source->pipe.file ? source->pipe.file : source->file))
+      source->failed = true;
+    /* a frame cut off by the end of the stream is dropped */
+    nframe = nread / source->frame_bytes;
+    src = source->scratch;
+  }
+  source_convert(dest, src, nframe * source->nchannel, source->format);
+  source->pos += nframe;
+  return nframe;
+}
+
+int source_seek(struct source *source, size_t pos) {
+  if (!source->seekable)
+    return MP3D_E_IOERROR;
+  if (source->kind == SOURCE_PCM) {
+    source->pos = pos > source->nframe ? source->nframe : pos;
+    return 0;
+  }
+  int err = mp3dec_ex_seek(&source->dec, (uint64_t)pos * source->nchannel);
+  /* the first seek made mp3dec_ex scan the file, keep the result */
+  if (!err && !source->indexed && source->dec.indexes_built)
+    source->indexed = seekindex_save(&source->dec, source->path);
+  return err;
+}
+
+void source_finish(struct source *source) {
+  /* the file was just read through, so scanning it again mostly hits the page cache */
+  if (source->kind == SOURCE_MP3 && source->path && !source->indexed)
+    source->indexed = seekindex_build(source->path);
+}
+
+bool source_special(const char *path) {
+  return strcmp(path, SOURCE_STDIN) == 0 || strncmp(path, SOURCE_RAW_PREFIX, strlen(SOURCE_RAW_PREFIX)) == 0;
+}
@@ -0,0 +1,218 @@
+#include "spectrogram.h"
+#include "fft.h"
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define SPECTROGRAM_MAGIC   "FFTSPG"
+
+struct spectrogram_header {
+  char magic[8];
+  uint32_t version;
+  uint32_t bits;
+  uint32_t nchannel;
+  uint32_t rate;
+  uint32_t logsize;
+  uint32_t nbin;
+  uint32_t hop;
+  uint32_t block;
+  float min_db;
+  float max_db;
+  uint64_t nframe;
+  uint64_t nblock;
+};
+
+static void *spectrogram_alloc(size_t size) {
+  void *ptr = malloc(size);
+  if (!ptr) {
+    fprintf(stderr, "failed to allocate memory\n");
+    exit(EXIT_FAILURE);
+  }
+  return ptr;
+}
+
+static bool spectrogram_path(char *path, size_t size, uint64_t key, size_t logsize) {
+  char suffix[32];
+  snprintf(suffix, sizeof (suffix), "%d-%zu.spg", SPECTROGRAM_VERSION, logsize);
+  return cache_path(path, size, key, suffix);
+}
+
+static inline size_t spectrogram_step_bytes(unsigned int bits) {
+  return bits > 8 ? 2 : 1;
+}
+
+static inline size_t spectrogram_block_bytes(size_t nframe, size_t nchannel, size_t nbin, unsigned int bits) {
+  return nframe * nchannel * nbin * spectrogram_step_bytes(bits);
+}
+
+static inline unsigned int spectrogram_quantize(float amplitude, unsigned int maxstep) {
+  float db = 20.0f * log10f(amplitude);
+  if (!(db > SPECTROGRAM_MIN_DB))
+    return 0;
+  if (db >= SPECTROGRAM_MAX_DB)
+    return maxstep;
+  return (unsigned int)lrintf((db - SPECTROGRAM_MIN_DB) / (SPECTROGRAM_MAX_DB - SPECTROGRAM_MIN_DB) * maxstep);
+}
+
+bool spectrogram_build(uint64_t key, const mp3d_sample_t *pcm, size_t nframe, int nchannel, unsigned int rate,
+                       size_t logsize, float scale, unsigned int bits) {
+  size_t size = (size_t)1 << logsize;
+  size_t nbin = size / 2 + 1;
+  size_t nspec = nframe >= size ? (nframe - size) / SPECTROGRAM_HOP + 1 : 0;
+  size_t nblock = (nspec + SPECTROGRAM_BLOCK - 1) / SPECTROGRAM_BLOCK;
+  unsigned int maxstep = ((unsigned int)1 << bits) - 1;
+
+  char path[CACHE_PATH_MAX], tmppath[CACHE_PATH_MAX];
+  if (!spectrogram_path(path, sizeof (path), key, logsize) || !cache_tmppath(tmppath, sizeof (tmppath), path))
+    return false;
+  FILE *file = fopen(tmppath, "wb");
+  if (!file)
+    return false;
+
+  struct spectrogram_header header = {
+    .magic = SPECTROGRAM_MAGIC,
+    .version = SPECTROGRAM_VERSION,
+    .bits = bits,
+    .nchannel = nchannel,
+    .rate = rate,
+    .logsize = logsize,
+    .nbin = nbin,
+    .hop = SPECTROGRAM_HOP,
+    .block = SPECTROGRAM_BLOCK,
+    .min_db = SPECTROGRAM_MIN_DB,
+    .max_db = SPECTROGRAM_MAX_DB,
+    .nframe = nspec,
+    .nblock = nblock,
+  };
+  bool ok = fwrite(&header, sizeof (header), 1, file) == 1;
+
+  /* every block is full but the last, so the offsets are known up front */
+  uint64_t offset = sizeof (header) + sizeof (uint64_t) * nblock;
+  for (size_t b = 0; ok && b < nblock; ++b) {
+    ok = fwrite(&offset, sizeof (offset), 1, file) == 1;
+    offset += spectrogram_block_bytes(SPECTROGRAM_BLOCK, nchannel, nbin, bits);
+  }
+
+  fft_complex_t *batch = spectrogram_alloc(sizeof (batch[0]) * size * SPECTROGRAM_BLOCK);
+  void *block = spectrogram_alloc(spectrogram_block_bytes(SPECTROGRAM_BLOCK, nchannel, nbin, bits));
+  uint8_t *block8 = block;
+  uint16_t *block16 = block;
+  for (size_t b = 0; ok && b < nblock; ++b) {
+    size_t first = b * SPECTROGRAM_BLOCK;
+    size_t count = nspec - first > SPECTROGRAM_BLOCK ? SPECTROGRAM_BLOCK : nspec - first;
+    for (int channel = 0; channel < nchannel; ++channel) {
+      for (size_t f = 0; f < count; ++f) {
+        const mp3d_sample_t *frame = pcm + (first + f) * SPECTROGRAM_HOP * nchannel + channel;
+        fft_complex_t *out = batch + f * size;
+        for (size_t i = 0; i < size; ++i) {
+          out[i].real = frame[i * nchannel];
+          out[i].imag = 0.0f;
+        }
+      }
+      fft_batch_inplace(batch, count, logsize);
+      /* same normalization as the live view */
+      for (size_t f = 0; f < count; ++f) {
+        const fft_complex_t *out = batch + f * size;
+        size_t row = (f * nchannel + channel) * nbin;
+        for (size_t k = 0; k < nbin; ++k) {
+          float amplitude = sqrtf(out[k].real * out[k].real + out[k].imag * out[k].imag) * 2 / size / scale;
+          if (k == 0 || k == size / 2)
+            amplitude /= 2;
+          unsigned int step = spectrogram_quantize(amplitude, maxstep);
+          if (bits > 8)
+            block16[row + k] = step;
+          else
+            block8[row + k] = step;
+        }
+      }
+    }
+    size_t nbyte = spectrogram_block_bytes(count, nchannel, nbin, bits);
+    ok = fwrite(block, 1, nbyte, file) == nbyte;
+  }
+  free(batch);
+  free(block);
+
+  if (fclose(file) || !ok) {
+    remove(tmppath);
+    return false;
+  }
+  return cache_commit(tmppath, path);
+}
+
+static bool spectrogram_valid(const struct spectrogram_header *header, size_t size, size_t logsize) {
+  if (memcmp(header->magic, SPECTROGRAM_MAGIC, sizeof (SPECTROGRAM_MAGIC)) ||
+      header->version != SPECTROGRAM_VERSION || header->logsize != logsize ||
+      header->nbin != ((size_t)1 << logsize) / 2 + 1 || header->nchannel == 0 || header->hop == 0 ||
+      header->block != SPECTROGRAM_BLOCK || (header->bits != 8 && header->bits != 16) ||
+      header->min_db != SPECTROGRAM_MIN_DB || header->max_db != SPECTROGRAM_MAX_DB ||
+      header->nblock != (header->nframe + header->block - 1) / header->block)
+    return false;
+  if ((size - sizeof (*header)) / sizeof (uint64_t) < header->nblock)
+    return false;
+  /* a truncated file is as good as none */
+  const uint64_t *index = (const uint64_t *)(header + 1);
+  for (size_t b = 0; b < header->nblock; ++b) {
+    size_t count = header->nframe - b * header->block > header->block ? header->block : header->nframe - b * header->block;
+    size_t nbyte = spectrogram_block_bytes(count, header->nchannel, header->nbin, header->bits);
+    if (index[b] > size || size - index[b] < nbyte || index[b] % spectrogram_step_bytes(header->bits))
+      return false;
+  }
+  return true;
+}
+
+bool spectrogram_open(struct spectrogram *spec, uint64_t key, size_t logsize) {
+  char path[CACHE_PATH_MAX];
+  memset(spec, 0, sizeof (*spec));
+  if (!spectrogram_path(path, sizeof (path), key, logsize) || !cache_map(&spec->mapping, path))
+    return false;
+
+  const struct spectrogram_header *header = spec->mapping.base;
+  if (spec->mapping.size < sizeof (*header) || !spectrogram_valid(header, spec->mapping.size, logsize)) {
+    cache_unmap(&spec->mapping);
+    return false;
+  }
+  spec->index = (const uint64_t *)(header + 1);
+  spec->nframe = header->nframe;
+  spec->nblock = header->nblock;
+  spec->hop = header->hop;
+  spec->nbin = header->nbin;
+  spec->nchannel = header->nchannel;
+  spec->bits = header->bits;
+
+  /* a table lookup per bin instead of a powf() */
+  unsigned int maxstep = ((unsigned int)1 << spec->bits) - 1;
+  spec->levels = spectrogram_alloc(sizeof (spec->levels[0]) * (maxstep + 1));
+  spec->levels[0] = 0.0f;
+  for (unsigned int step = 1; step <= maxstep; ++step) {
+    float db = SPECTROGRAM_MIN_DB + (SPECTROGRAM_MAX_DB - SPECTROGRAM_MIN_DB) * step / maxstep;
+    spec->levels[step] = powf(10.0f, db / 20.0f);
+  }
+  return true;
+}
+
+void spectrogram_close(struct spectrogram *spec) {
+  cache_unmap(&spec->mapping);
+  free(spec->levels);
+  spec->levels = NULL;
+}
+
+bool spectrogram_frame(const struct spectrogram *spec, size_t pos, int channel, float *amplitudes) {
+  size_t frame = (pos + spec->hop / 2) / spec->hop;
+  if (frame >= spec->nframe || channel >= spec->nchannel)
+    return false;
+  size_t block = frame / SPECTROGRAM_BLOCK;
+  size_t row = ((frame % SPECTROGRAM_BLOCK) * spec->nchannel + channel) * spec->nbin;
+  const uint8_t *base = (const uint8_t *)spec->mapping.base + spec->index[block];
+  if (spec->bits > 8) {
+    const uint16_t *steps = (const uint16_t *)base + row;
+    for (size_t k = 0; k < spec->nbin; ++k)
+      amplitudes[k] = spec->levels[steps[k]];
+  } else {
+    const uint8_t *steps = base + row;
+    for (size_t k = 0; k < spec->nbin; ++k)
+      amplitudes[k] = spec->levels[steps[k]];
+  }
+  return true;
+}
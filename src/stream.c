@@ -0,0 +1,226 @@
+#include "stream.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+static void stream_sleep(long ns) {
+  struct timespec ts = { .tv_sec = 0, .tv_nsec = ns };
+  nanosleep(&ts, NULL);
+}
+
+/* frames that can be decoded without overwriting unread frames or the history behind them.
+ * STREAM_GUARD frames more than stream_has() promises stay, see there */
+static size_t stream_writable(const struct pcm_stream *stream, size_t writepos) {
+  size_t readpos = atomic_load_explicit(&stream->readpos, memory_order_acquire);
+  size_t keep = readpos - stream->startpos > STREAM_HISTORY + STREAM_GUARD ? STREAM_HISTORY + STREAM_GUARD
+                                                                           : readpos - stream->startpos;
+  return STREAM_CAPACITY - (writepos - readpos) - keep;
+}
+
+/* decode one chunk, returns the number of frames decoded */
+static size_t stream_fill(struct pcm_stream *stream) {
+  size_t nchannel = stream->nchannel;
+  /* only this thread moves writepos */
+  size_t writepos = atomic_load_explicit(&stream->writepos, memory_order_relaxed);
+  size_t writable = stream_writable(stream, writepos);
+  size_t offset = writepos & STREAM_MASK;
+  size_t nframe = writable > STREAM_CHUNK ? STREAM_CHUNK : writable;
+  if (nframe > STREAM_CAPACITY - offset)
+    nframe = STREAM_CAPACITY - offset;
+  if (nframe == 0)
+    return 0;
+
+  mp3d_sample_t *dest = stream->data + offset * nchannel;
+  size_t ndecoded = source_read(&stream->source, dest, nframe);
+
+  /* keep the mirror past the end in sync */
+  if (offset < STREAM_SPAN) {
+    size_t nmirror = offset + ndecoded > STREAM_SPAN ? STREAM_SPAN - offset : ndecoded;
+    memcpy(stream->data + (STREAM_CAPACITY + offset) * nchannel, dest, sizeof (dest[0]) * nmirror * nchannel);
+  }
+  if (stream->caching && !cache_writer_write(&stream->writer, dest, ndecoded))
+    stream->caching = false;
+  /* publish the frames only after they are written */
+  atomic_store_explicit(&stream->writepos, writepos + ndecoded, memory_order_release);
+  if (ndecoded < nframe) {
+    /* a decode error cuts the track short, it must not be cached like that.
+     * a file opened without a remembered key is hashed only now, off the startup path */
+    uint64_t key = stream->key;
+    if (stream->caching && !stream->source.failed && (stream->haskey || cache_key(stream->source.path, &key)))
+      cache_writer_finish(&stream->writer, key);
+    else if (stream->caching)
+      cache_writer_abort(&stream->writer);
+    stream->caching = false;
+    atomic_store_explicit(&stream->eof, true, memory_order_release);
+  }
+  return ndecoded;
+}
+
+static void *stream_decoder(void *arg) {
+  struct pcm_stream *stream = arg;
+  while (!atomic_load_explicit(&stream->quit, memory_order_relaxed) &&
+         !atomic_load_explicit(&stream->eof, memory_order_relaxed)) {
+    if (stream_fill(stream) == 0 && !atomic_load_explicit(&stream->eof, memory_order_relaxed))
+      stream_sleep(STREAM_IDLE_NS);
+  }
+  if (!stream->source.failed && !atomic_load_explicit(&stream->quit, memory_order_relaxed))
+    source_finish(&stream->source);
+  return NULL;
+}
+
+int stream_open(struct pcm_stream *stream, const char *path) {
+  memset(stream, 0, sizeof (*stream));
+  /* hashing a large file takes a while, only a key remembered from an earlier open is used here */
+  stream->haskey = !source_special(path) && cache_recall_key(path, &stream->key);
+  if (stream->haskey && cache_open(&stream->cache, stream->key)) {
+    stream->nchannel = stream->cache.nchannel;
+    stream->rate = stream->cache.rate;
+    stream->frames = stream->cache.data;
+    stream->nframe = stream->cache.nframe;
+    atomic_init(&stream->writepos, stream->nframe);
+    atomic_init(&stream->readpos, 0);
+    atomic_init(&stream->eof, true);
+    atomic_init(&stream->quit, false);
+    return 0;
+  }
+
+  int err = source_open(&stream->source, path);
+  if (err)
+    return err;
+  stream->nchannel = stream->source.nchannel;
+  stream->rate = stream->source.rate;
+  if (stream->source.frames) {
+    stream->frames = stream->source.frames;
+    stream->nframe = stream->source.nframe;
+    atomic_init(&stream->writepos, stream->nframe);
+    atomic_init(&stream->readpos, 0);
+    atomic_init(&stream->eof, true);
+    atomic_init(&stream->quit, false);
+    return 0;
+  }
+
+  stream->data = malloc(sizeof (stream->data[0]) * (STREAM_CAPACITY + STREAM_SPAN) * stream->nchannel);
+  if (!stream->data) {
+    source_close(&stream->source);
+    return MP3D_E_MEMORY;
+  }
+
+  atomic_init(&stream->writepos, 0);
+  atomic_init(&stream->readpos, 0);
+  atomic_init(&stream->eof, false);
+  atomic_init(&stream->quit, false);
+  /* pcm sources are cheap to read again */
+  stream->caching = stream->source.kind == SOURCE_MP3 && stream->source.path &&
+                    cache_writer_begin(&stream->writer, stream->nchannel, stream->rate);
+  if (pthread_create(&stream->thread, NULL, stream_decoder, stream)) {
+    if (stream->caching)
+      cache_writer_abort(&stream->writer);
+    source_close(&stream->source);
+    free(stream->data);
+    return MP3D_E_MEMORY;
+  }
+  return 0;
+}
+
+void stream_close(struct pcm_stream *stream) {
+  if (stream->cache.data) {
+    cache_close(&stream->cache);
+    return;
+  }
+  if (stream->frames) {
+    source_close(&stream->source);
+    return;
+  }
+  atomic_store_explicit(&stream->quit, true, memory_order_relaxed);
+  pthread_join(stream->thread, NULL);
+  /* stopped before the end, the entry would be incomplete */
+  if (stream->caching)
+    cache_writer_abort(&stream->writer);
+  source_close(&stream->source);
+  free(stream->data);
+}
+
+size_t stream_seek(struct pcm_stream *stream, size_t pos) {
+  if (stream->frames) {
+    if (pos > stream->nframe)
+      pos = stream->nframe;
+    atomic_store_explicit(&stream->readpos, pos, memory_order_relaxed);
+    return pos;
+  }
+  if (stream->source.nframe && pos > stream->source.nframe)
+    pos = stream->source.nframe;
+
+  /* the decoder thread owns 'dec' while it runs, restarting it is cheaper than handing the seek over */
+  atomic_store_explicit(&stream->quit, true, memory_order_relaxed);
+  pthread_join(stream->thread, NULL);
+  /* the entry must hold the track in one piece */
+  if (stream->caching)
+    cache_writer_abort(&stream->writer);
+  stream->caching = false;
+
+  bool failed = source_seek(&stream->source, pos) != 0;
+
+  stream->startpos = pos;
+  atomic_store_explicit(&stream->writepos, pos, memory_order_relaxed);
+  atomic_store_explicit(&stream->readpos, pos, memory_order_relaxed);
+  atomic_store_explicit(&stream->eof, failed, memory_order_relaxed);
+  atomic_store_explicit(&stream->quit, false, memory_order_relaxed);
+  if (failed)
+    return pos;
+
+  stream_fill(stream);
+  if (pthread_create(&stream->thread, NULL, stream_decoder, stream)) {
+    fprintf(stderr, "failed to restart the decoder thread\n");
+    exit(EXIT_FAILURE);
+  }
+  return pos;
+}
+
+bool stream_seekable(const struct pcm_stream *stream) {
+  return stream->frames || stream->source.seekable;
+}
+
+void stream_wait(const struct pcm_stream *stream, size_t nframe) {
+  while (stream_readable(stream) < nframe && !atomic_load_explicit(&stream->eof, memory_order_acquire))
+    stream_sleep(STREAM_IDLE_NS / 5);
+}
+
+size_t stream_readable(const struct pcm_stream *stream) {
+  return atomic_load_explicit(&stream->writepos, memory_order_acquire) -
+         atomic_load_explicit(&stream->readpos, memory_order_relaxed);
+}
+
+size_t stream_written(const struct pcm_stream *stream) {
+  return atomic_load_explicit(&stream->writepos, memory_order_acquire);
+}
+
+bool stream_has(const struct pcm_stream *stream, size_t pos, size_t nframe) {
+  /* analysers read without a lock while the audio writer moves 'readpos' on, and with it the
+   * oldest frame the decoder may overwrite. the decoder keeps STREAM_GUARD frames beyond the
+   * history, so what is found here stays intact while 'readpos' moves less than that */
+  size_t readpos = atomic_load_explicit(&stream->readpos, memory_order_relaxed);
+  size_t oldest = readpos - stream->startpos > STREAM_HISTORY ? readpos - STREAM_HISTORY : stream->startpos;
+  if (stream->frames)
+    oldest = 0;
+  return pos >= oldest && pos + nframe <= stream_written(stream);
+}
+
+const mp3d_sample_t *stream_at(const struct pcm_stream *stream, size_t pos) {
+  if (stream->frames)
+    return stream->frames + pos * stream->nchannel;
+  return stream->data + (pos & STREAM_MASK) * stream->nchannel;
+}
+
+void stream_consume(struct pcm_stream *stream, size_t nframe) {
+  /* hand the frames back to the decoder only after they are read */
+  atomic_fetch_add_explicit(&stream->readpos, nframe, memory_order_release);
+}
+
+bool stream_decoded(const struct pcm_stream *stream) {
+  return atomic_load_explicit(&stream->eof, memory_order_acquire);
+}
+
+bool stream_end(const struct pcm_stream *stream) {
+  return atomic_load_explicit(&stream->eof, memory_order_acquire) && stream_readable(stream) == 0;
+}